@@ -171,7 +171,6 @@ class DataCollectionSystem:
             print(f"Initializing robot data collection...")
             
             self.robot_data = start_collection(
-                mode='collect',
                 ip="192.168.1.25",
                 output_file=robot_file,
                 stop_flag=self.stop_flag,
@@ -214,8 +213,15 @@ class DataCollectionSystem:
         
         if self.lembox.start_recording(filename):
             print("Started LEM Box recording...")
+            last_report = time.time()
             while self.is_collecting:
                 time.sleep(0.1)
+                status = self.lembox.status
+                if status and time.time() - last_report >= 10:
+                    print(f"LEM Box: {status['samples']} samples, {status['rate_hz']:.0f} Hz, "
+                          f"queue {status['queue']} (max {status['queue_hwm']}), "
+                          f"writer lag {status['writer_lag_s']:.1f} s")
+                    last_report = time.time()
             
             print("Stopping LEM Box recording...")
             self.lembox.stop_recording()
@@ -1,55 +1,147 @@
 import ctypes
+import json
 import os
 import subprocess
-from typing import Optional
+import threading
+
+class LEMBoxSample(ctypes.Structure):
+    """LEMBOX_SAMPLE from LEMBOXLIB.H, channels in microvolts at the ADC input."""
+    _fields_ = [
+        ("perf_time", ctypes.c_double),
+        ("sample_number", ctypes.c_ulong),
+        ("voltage_raw", ctypes.c_ushort),
+        ("current_raw", ctypes.c_ushort),
+        ("voltage_uv", ctypes.c_int),
+        ("current_uv", ctypes.c_int),
+    ]
+
+class LEMBoxStats(ctypes.Structure):
+    """LEMBOX_STATS from LEMBOXLIB.H."""
+    _fields_ = [
+        ("running", ctypes.c_int),
+        ("sample_rate", ctypes.c_double),
+        ("samples", ctypes.c_ulong),
+        ("samples_written", ctypes.c_ulong),
+        ("bytes_written", ctypes.c_ulonglong),
+        ("queue_count", ctypes.c_ulong),
+        ("queue_high_water", ctypes.c_ulong),
+        ("spill_backlog", ctypes.c_long),
+        ("spill_events", ctypes.c_ulong),
+        ("spill_blocks", ctypes.c_long),
+        ("spill_dropped", ctypes.c_ulong),
+        ("buffer_errors", ctypes.c_ulong),
+        ("write_errors", ctypes.c_ulong),
+        ("spill_io_errors", ctypes.c_ulong),
+        ("captures", ctypes.c_ulong),
+        ("spectral_windows", ctypes.c_ulong),
+        ("spectral_skipped", ctypes.c_ulong),
+        ("spectral_dropped", ctypes.c_ulong),
+        ("sim_overruns", ctypes.c_ulong),
+        ("sim_trigger_measured", ctypes.c_int),
+        ("sim_trigger_error_us", ctypes.c_double),
+        ("turnaround_p50_us", ctypes.c_double),
+        ("turnaround_p99_us", ctypes.c_double),
+        ("turnaround_max_us", ctypes.c_double),
+        ("turnaround_mean_us", ctypes.c_double),
+        ("page_faults", ctypes.c_ulong),
+        ("sample_rate_nominal", ctypes.c_int),
+    ]
 
 class LEMBox:
-    def __init__(self):
+    """In-process acquisition through LEMBOXLIB.dll, the library behind LEMBOX.exe.
+    Samples are read from the library's memory with no process or file in between.
+    """
+    def __init__(self, lib_path=None):
         try:
-            # Load the compiled C library (assuming it's named 'dt9816s.dll' for Windows)
-            # Change path as needed
-            lib_path = os.path.join(os.path.dirname(__file__), 'dt9816s.dll')
+            lib_path = lib_path or os.path.join(os.path.dirname(__file__), 'LEMBOXLIB.dll')
             self._lib = ctypes.CDLL(lib_path)
-            self.device_handle = None
-            self.initialized = False
         except Exception as e:
-            raise RuntimeError(f"Failed to load DT9816-S library: {str(e)}")
-
-    def initialize(self) -> bool:
-        """Initialize the DT9816-S device"""
-        if hasattr(self._lib, 'dt9816s_init'):
-            self.device_handle = self._lib.dt9816s_init()
-            self.initialized = self.device_handle is not None
-            return self.initialized
-        return False
-
-    def read_voltage(self, channel: int) -> Optional[float]:
-        """Read voltage from specified channel"""
-        if not self.initialized:
-            return None
-        
-        if hasattr(self._lib, 'dt9816s_read_voltage'):
-            voltage = ctypes.c_double()
-            result = self._lib.dt9816s_read_voltage(
-                self.device_handle,
-                ctypes.c_int(channel),
-                ctypes.byref(voltage)
-            )
-            if result == 0:  # Assuming 0 is success
-                return voltage.value
-        return None
+            raise RuntimeError(f"Failed to load LEM Box library: {str(e)}")
+        self._lib.LemBoxConfigure.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        self._lib.LemBoxStart.argtypes = [ctypes.c_char_p]
+        self._lib.LemBoxReadLatest.argtypes = [ctypes.POINTER(LEMBoxSample), ctypes.c_size_t]
+        self._lib.LemBoxReadLatest.restype = ctypes.c_size_t
+        self._lib.LemBoxLatestRing.argtypes = [ctypes.POINTER(ctypes.c_ulong)]
+        self._lib.LemBoxLatestRing.restype = ctypes.POINTER(LEMBoxSample)
+        self._lib.LemBoxLatestHead.restype = ctypes.c_ulong
+        self._lib.LemBoxGetStats.argtypes = [ctypes.POINTER(LEMBoxStats)]
+        self._lib.LemBoxErrorName.restype = ctypes.c_char_p
+        self._lib.LemBoxClose.restype = None
+        self.initialized = False
+
+    def _check(self, result):
+        if result != 0:
+            raise RuntimeError(f"LEM Box: {self._lib.LemBoxErrorName(result).decode()}")
+
+    def configure(self, option, value):
+        """Set a LEMBOX.exe option, e.g. configure('rate', 20000), before start()."""
+        if isinstance(value, bool):
+            value = int(value)
+        self._check(self._lib.LemBoxConfigure(option.encode(), str(value).encode()))
+
+    def initialize(self, simulate=False) -> bool:
+        """Find the DT9816-S, or use the simulated board"""
+        try:
+            self.configure('simulate', simulate)
+            self._check(self._lib.LemBoxOpen())
+            self.initialized = True
+        except RuntimeError as e:
+            print(str(e))
+            self.initialized = False
+        return self.initialized
+
+    def start(self, filename=None):
+        """Start acquiring, writing the usual files when filename is given."""
+        path = os.path.abspath(filename).encode() if filename else None
+        self._check(self._lib.LemBoxStart(path))
+
+    def read_latest(self, count):
+        """The newest samples, oldest first, as a LEMBoxSample array."""
+        samples = (LEMBoxSample * count)()
+        n = self._lib.LemBoxReadLatest(samples, count)
+        return samples[:n]
+
+    def latest_ring(self):
+        """The library's ring of recent samples without copying, and the number
+        of samples acquired.  Sample n is at ring[n % len(ring)] until the count
+        passes n + len(ring) - 4000; check its sample_number after reading.
+        """
+        size = ctypes.c_ulong()
+        ring = self._lib.LemBoxLatestRing(ctypes.byref(size))
+        if not ring:
+            return None, 0
+        view = ctypes.cast(ring, ctypes.POINTER(LEMBoxSample * size.value)).contents
+        return view, self._lib.LemBoxLatestHead()
+
+    def trigger_capture(self):
+        """Fire a capture window when configured with capture-pre/capture-post."""
+        return self._lib.LemBoxTrigger() == 0
+
+    def stats(self):
+        """Counters for the current or last run as a dict."""
+        stats = LEMBoxStats()
+        self._check(self._lib.LemBoxGetStats(ctypes.byref(stats)))
+        return {name: getattr(stats, name) for name, _ in LEMBoxStats._fields_}
+
+    def stop(self):
+        """Stop acquiring; returns once the files are complete."""
+        self._check(self._lib.LemBoxStop())
 
     def close(self):
         """Close the device connection"""
-        if self.initialized and hasattr(self._lib, 'dt9816s_close'):
-            self._lib.dt9816s_close(self.device_handle)
+        if self.initialized:
+            self._lib.LemBoxClose()
             self.initialized = False
-            self.device_handle = None
 
 class LEMBoxCollector:
     def __init__(self):
         self.process = None
         self.executable = os.path.join(os.path.dirname(__file__), "LEMBOX.exe")
+        self.status = None            # Latest status record from LEMBOX.exe
+        self.status_callback = None   # Called with every status record
+        self.max_writer_lag = 5.0     # Seconds of unwritten data before warning
+        self._last_errors = {}
+        self._lagging = False
         
     def check_connection(self):
         """Check if DT9816-S is accessible."""
@@ -78,32 +170,98 @@ class LEMBoxCollector:
             print(f"Error checking board: {str(e)}")
             return False
             
-    def start_recording(self, filename):
-        """Start data collection."""
+    def start_recording(self, filename, options=None, status=True):
+        """Start data collection.
+        options: extra LEMBOX.exe arguments, e.g. ['--capture', '500', '500'].
+        status: have LEMBOX.exe print a JSON status record every second.
+        """
         try:
             # Use absolute path for filename
             abs_filename = os.path.abspath(filename)
+            args = [self.executable, "--collect", abs_filename] + list(options or [])
+            if status:
+                args += ["--status", "stdout"]
+            self.status = None
+            self._last_errors = {}
+            self._lagging = False
             self.process = subprocess.Popen(
-                [self.executable, "--collect", abs_filename],
+                args,
+                stdin=subprocess.PIPE,
                 stdout=subprocess.PIPE,
-                stderr=subprocess.PIPE,
+                stderr=subprocess.STDOUT,
                 text=True
             )
+            # The output has to be read or LEMBOX.exe blocks once the pipe fills
+            threading.Thread(target=self._read_output, args=(self.process,), daemon=True).start()
             return True
         except Exception as e:
             print(f"Error starting LEM Box: {e}")
             return False
             
-    def stop_recording(self):
-        """Stop data collection."""
+    def _read_output(self, process):
+        """Read LEMBOX.exe output until it exits, keeping the status records."""
+        try:
+            for line in process.stdout:
+                line = line.strip()
+                if line.startswith("{"):
+                    try:
+                        record = json.loads(line)
+                    except ValueError:
+                        continue
+                    self.status = record
+                    self._check_status(record)
+                    if self.status_callback:
+                        self.status_callback(record)
+                elif line.startswith("ERROR"):
+                    print(f"LEM Box: {line}")
+        except Exception as e:
+            print(f"Error reading LEM Box output: {e}")
+
+    def _check_status(self, record):
+        """Warn when an error count goes up or the writer falls behind."""
+        errors = record.get("errors", {})
+        for name, count in errors.items():
+            if count > self._last_errors.get(name, 0):
+                print(f"Warning: LEM Box {name} errors: {count}")
+        self._last_errors = dict(errors)
+        
+        lagging = record.get("writer_lag_s", 0.0) > self.max_writer_lag
+        if lagging and not self._lagging:
+            print(f"Warning: LEM Box writer is {record['writer_lag_s']:.1f} s behind")
+        self._lagging = lagging
+
+    def trigger_capture(self):
+        """Fire a capture window when LEMBOX.exe runs with --capture."""
+        try:
+            kernel32 = ctypes.windll.kernel32
+            EVENT_MODIFY_STATE = 0x0002
+            handle = kernel32.OpenEventW(EVENT_MODIFY_STATE, False, "LEMBOX_CAPTURE_TRIGGER")
+            if not handle:
+                return False
+            result = kernel32.SetEvent(handle)
+            kernel32.CloseHandle(handle)
+            return bool(result)
+        except Exception as e:
+            print(f"Error triggering LEM Box capture: {e}")
+            return False
+
+    def stop_recording(self, timeout=5):
+        """Stop data collection.
+        LEMBOX.exe is asked to stop with "q" so it drains the writer and
+        finishes the files; it is only terminated if it does not exit in time.
+        """
         if self.process:
             try:
-                self.process.terminate()
-                # Wait for process to terminate
                 try:
-                    self.process.wait(timeout=5)
-                except subprocess.TimeoutExpired:
-                    self.process.kill()
+                    self.process.stdin.write("q\n")
+                    self.process.stdin.close()
+                    self.process.wait(timeout=timeout)
+                except (OSError, subprocess.TimeoutExpired):
+                    self.process.terminate()
+                    try:
+                        self.process.wait(timeout=timeout)
+                    except subprocess.TimeoutExpired:
+                        self.process.kill()
                 self.process = None
             except Exception as e:
                 print(f"Error stopping LEM Box: {e}")
\ No newline at end of file
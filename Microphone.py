@@ -6,6 +6,7 @@ from datetime import datetime, timedelta
 import threading
 import time
 import os
+import subprocess
 
 # Set recording parameters
 FORMAT = pyaudio.paFloat32 
@@ -196,4 +197,166 @@ class MicrophoneRecorder:
         print("Stopping recording...")
         self.is_recording = False
         self.record_thread.join()
-        return True
\ No newline at end of file
+        return True
+
+MIC_RECORDER = os.path.join(os.path.dirname(__file__), "MicRecorder.exe")
+
+def start_native_recording(filename, device="485B39", api=1, rate=RATE, chunk=CHUNK, simulate=False,
+                           features=False, channels=CHANNELS, split_channels=False, feature_channel=1):
+    """Record with the native MicRecorder, which streams the audio to filename
+    while it runs (.wav float32, .flac 24-bit, anything else raw float32) and
+    one timing record per audio buffer to <filename without
+    extension>_chunks.bin.  channels inputs of the device are recorded
+    interleaved, or with split_channels to one mono file per channel,
+    <filename without extension>_ch1.wav and so on.  simulate records a
+    synthetic tone instead of the device.  features also writes RMS, band
+    powers, spectral centroid and short-circuit clicks of feature_channel
+    every 10 ms to <filename without extension>_features.csv (see
+    load_features).  Returns the process for stop_native_recording."""
+    args = [MIC_RECORDER, "--record", os.path.abspath(filename), "--rate", str(rate), "--chunk", str(chunk),
+            "--channels", str(channels)]
+    if split_channels:
+        args += ["--split-channels"]
+    if simulate:
+        args += ["--simulate"]
+    else:
+        args += ["--device", device, "--api", str(api)]
+    if features:
+        args += ["--features", "--feature-channel", str(feature_channel)]
+    try:
+        return subprocess.Popen(args, stdin=subprocess.PIPE, text=True)
+    except Exception as e:
+        print(f"Error starting microphone recorder: {e}")
+        return None
+
+def stop_native_recording(process, timeout=5):
+    """Ask MicRecorder to finish writing and exit."""
+    if not process:
+        return
+    try:
+        process.communicate("q\n", timeout=timeout)
+    except subprocess.TimeoutExpired:
+        process.kill()
+    except Exception as e:
+        print(f"Error stopping microphone recorder: {e}")
+
+MIC_CSV_CONVERT = os.path.join(os.path.dirname(__file__), "MicCsvConvert.exe")
+
+def convert_legacy_csv(filename, output_file=None, threads=None):
+    """Convert a microphone_data.csv written by _save_data with the native
+    MicCsvConvert.  output_file defaults to the CSV's name with .wav; .wav,
+    .flac and raw outputs get a _chunks.bin timing sidecar like a
+    MicRecorder recording (read them with load_native_recording), .arrow
+    writes the sample, relative_time, timestamp and amplitude columns.
+    Returns the output file name, or None if the conversion failed."""
+    if output_file is None:
+        output_file = os.path.splitext(filename)[0] + ".wav"
+    args = [MIC_CSV_CONVERT, os.path.abspath(filename), "--out", os.path.abspath(output_file)]
+    if threads:
+        args += ["--threads", str(threads)]
+    try:
+        result = subprocess.run(args, capture_output=True, text=True)
+    except Exception as e:
+        print(f"Error starting CSV converter: {e}")
+        return None
+    if "OK:CONVERT_COMPLETE" not in result.stdout:
+        print(f"Error converting {filename}: {result.stdout.strip()}")
+        return None
+    return output_file
+
+def load_chunk_timing(filename):
+    """Read the _chunks.bin sidecar of a MicRecorder recording (or give the
+    audio file's name).  Returns (records, rate, channels), the records a
+    numpy structured array with one row per audio buffer: sample_index (first
+    frame in the audio file), device_index (the same counting dropped
+    frames), frames, status, unix_time_ns (host time the buffer arrived),
+    adc_time and corrected_unix_ns (the first frame on the fitted device
+    clock, which load_native_recording and load_features use)."""
+    if not filename.endswith("_chunks.bin"):
+        filename = os.path.splitext(filename)[0] + "_chunks.bin"
+    with open(filename, "rb") as f:
+        if f.read(8) != b"MICCHNK1":
+            raise ValueError(f"{filename} is not a MicRecorder timing file")
+        header_length = int.from_bytes(f.read(4), "little")
+        settings, columns = f.read(header_length).decode("ascii").split(";")
+        settings = dict(item.split("=") for item in settings.split(","))
+        dtype = np.dtype([(name, "<" + kind) for name, kind in
+                          (column.split(":") for column in columns.split(","))])
+        return np.fromfile(f, dtype=dtype), int(settings["rate"]), int(settings["channels"])
+
+def read_audio_file(filename, channels=1):
+    """Samples of a MicRecorder audio file as float32, shape (frames, channels)."""
+    extension = os.path.splitext(filename)[1].lower()
+    if extension == ".flac":
+        import soundfile
+        samples, _ = soundfile.read(filename, dtype="float32", always_2d=True)
+        return samples
+    with open(filename, "rb") as f:
+        if extension == ".wav":
+            # Walk the chunks to the data, RIFF or RF64
+            f.seek(12)
+            while True:
+                chunk_id = f.read(4)
+                if len(chunk_id) < 4:
+                    raise ValueError(f"{filename} has no data chunk")
+                size = int.from_bytes(f.read(4), "little")
+                if chunk_id == b"fmt ":
+                    fmt = f.read(size)
+                    channels = int.from_bytes(fmt[2:4], "little")
+                elif chunk_id == b"data":
+                    break
+                else:
+                    f.seek(size + (size & 1), 1)
+        samples = np.fromfile(f, dtype="<f4")
+    return samples[:len(samples) - len(samples) % channels].reshape(-1, channels)
+
+def load_native_recording(filename):
+    """Read a MicRecorder recording.  Returns (samples, relative_times), the
+    samples shaped (frames, channels) when there is more than one channel
+    and the times in seconds from the first sample on the host clock.  They
+    come from the recorder's fit of the device's sample clock to host time,
+    so they step evenly at the device's true rate with no callback jitter.
+    A recording split into channel files is read by its original name."""
+    chunks, rate, channels = load_chunk_timing(filename)
+    stem, extension = os.path.splitext(filename)
+    if channels > 1 and not os.path.exists(filename):
+        samples = np.hstack([read_audio_file(f"{stem}_ch{c + 1}{extension}") for c in range(channels)])
+    else:
+        samples = read_audio_file(filename, channels)
+    if channels == 1:
+        samples = samples[:, 0]
+    if len(samples) == 0 or len(chunks) == 0:
+        return samples, np.zeros(0)
+    starts = chunks["sample_index"]
+    corrected = (chunks["corrected_unix_ns"] - chunks["corrected_unix_ns"][0]) / 1e9
+    index = np.arange(len(samples))
+    times = np.interp(index, starts, corrected)
+    # Past the last buffer's first sample, go on at the last fitted rate
+    step = 1.0 / rate
+    if len(starts) > 1 and starts[-1] > starts[-2]:
+        step = (corrected[-1] - corrected[-2]) / (starts[-1] - starts[-2])
+    after = index > starts[-1]
+    times[after] = corrected[-1] + (index[after] - starts[-1]) * step
+    return samples, times
+
+def load_features(filename):
+    """Read the _features.csv of a MicRecorder recording (or give the audio
+    file's name) as a numpy structured array, one row per window, with a
+    Time column added: the corrected host time of the window's first
+    sample in seconds from the recording's first sample."""
+    if not filename.endswith("_features.csv"):
+        filename = os.path.splitext(filename)[0] + "_features.csv"
+    features = np.genfromtxt(filename, delimiter=",", names=True)
+    features = np.atleast_1d(features)
+    chunks, rate, _ = load_chunk_timing(filename[:-len("_features.csv")])
+    if len(chunks) > 0:
+        corrected = (chunks["corrected_unix_ns"] - chunks["corrected_unix_ns"][0]) / 1e9
+        times = np.interp(features["FirstSample"], chunks["sample_index"], corrected,
+                          right=np.nan)
+        # Past the last buffer's start, go on at the nominal rate
+        late = np.isnan(times)
+        times[late] = corrected[-1] + (features["FirstSample"][late] - chunks["sample_index"][-1]) / rate
+    else:
+        times = features["Seconds"]
+    from numpy.lib import recfunctions
+    return recfunctions.append_fields(features, "Time", times, usemask=False)
@@ -0,0 +1,321 @@
+// Windowed acoustic features of the weld microphone: RMS, energy in
+// frequency bands, spectral centroid and a click detector for short
+// circuits.  Computed on the recorder's feature thread from a real FFT, so
+// a run can be reviewed without going back to the raw audio.
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MIC_FFT_SSE
+#endif
+
+namespace Mic {
+
+// Power spectrum of n real samples (n a power of two) through an n/2 point
+// complex FFT: even samples go in the real part, odd ones in the imaginary
+// part, and the two halves are separated afterwards.  Stages of four or
+// more butterflies per group run four at a time in SSE.
+class RealFft {
+public:
+    explicit RealFft(size_t size) :
+        n(size),
+        half(size / 2),
+        re(half), im(half),
+        twiddleRe(half), twiddleIm(half),
+        splitRe(half), splitIm(half),
+        bitReverse(half)
+    {
+        int bits = 0;
+        while (((size_t)1 << bits) < half) {
+            bits++;
+        }
+        for (size_t i = 0; i < half; i++) {
+            size_t reversed = 0;
+            for (int bit = 0; bit < bits; bit++) {
+                reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+            }
+            bitReverse[i] = reversed;
+        }
+        // Twiddles for each stage, stage h at [h - 1, 2h - 1)
+        for (size_t h = 1; h < half; h <<= 1) {
+            for (size_t j = 0; j < h; j++) {
+                double angle = -Pi * j / h;
+                twiddleRe[h - 1 + j] = (float)cos(angle);
+                twiddleIm[h - 1 + j] = (float)sin(angle);
+            }
+        }
+        for (size_t k = 0; k < half; k++) {
+            double angle = -2.0 * Pi * k / n;
+            splitRe[k] = (float)cos(angle);
+            splitIm[k] = (float)sin(angle);
+        }
+    }
+
+    size_t Size() const { return n; }
+
+    // power[k] = |X[k]|^2 for k in [0, n/2)
+    void Power(const float* samples, double* power) {
+        for (size_t i = 0; i < half; i++) {
+            size_t j = bitReverse[i];
+            re[j] = samples[2 * i];
+            im[j] = samples[2 * i + 1];
+        }
+        Transform();
+
+        // X[k] = E[k] + w^k O[k], where E and O are the transforms of the
+        // even and odd samples: E = (Z[k] + conj Z[m-k]) / 2, O = (Z[k] - conj Z[m-k]) / 2i
+        for (size_t k = 0; k < half; k++) {
+            size_t mirror = k == 0 ? 0 : half - k;
+            double zr = re[k], zi = im[k];
+            double yr = re[mirror], yi = -im[mirror];
+            double er = 0.5 * (zr + yr), ei = 0.5 * (zi + yi);
+            double orr = 0.5 * (zi - yi), oi = -0.5 * (zr - yr);
+            double xr = er + splitRe[k] * orr - splitIm[k] * oi;
+            double xi = ei + splitRe[k] * oi + splitIm[k] * orr;
+            power[k] = xr * xr + xi * xi;
+        }
+    }
+
+private:
+    static constexpr double Pi = 3.14159265358979323846;
+
+    size_t n;
+    size_t half;
+    std::vector<float> re, im;
+    std::vector<float> twiddleRe, twiddleIm;
+    std::vector<float> splitRe, splitIm;
+    std::vector<size_t> bitReverse;
+
+    // In-place radix-2 FFT of re + i*im, already in bit-reversed order
+    void Transform() {
+        for (size_t h = 1; h < half; h <<= 1) {
+            const float* wRe = twiddleRe.data() + h - 1;
+            const float* wIm = twiddleIm.data() + h - 1;
+            for (size_t group = 0; group < half; group += 2 * h) {
+                float* aRe = re.data() + group;
+                float* aIm = im.data() + group;
+                float* bRe = aRe + h;
+                float* bIm = aIm + h;
+                size_t j = 0;
+#ifdef MIC_FFT_SSE
+                if (h >= 4) {
+                    for (; j < h; j += 4) {
+                        __m128 xr = _mm_loadu_ps(bRe + j);
+                        __m128 xi = _mm_loadu_ps(bIm + j);
+                        __m128 wr = _mm_loadu_ps(wRe + j);
+                        __m128 wi = _mm_loadu_ps(wIm + j);
+                        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                        __m128 ur = _mm_loadu_ps(aRe + j);
+                        __m128 ui = _mm_loadu_ps(aIm + j);
+                        _mm_storeu_ps(aRe + j, _mm_add_ps(ur, tr));
+                        _mm_storeu_ps(aIm + j, _mm_add_ps(ui, ti));
+                        _mm_storeu_ps(bRe + j, _mm_sub_ps(ur, tr));
+                        _mm_storeu_ps(bIm + j, _mm_sub_ps(ui, ti));
+                    }
+                }
+#endif
+                for (; j < h; j++) {
+                    float tr = bRe[j] * wRe[j] - bIm[j] * wIm[j];
+                    float ti = bRe[j] * wIm[j] + bIm[j] * wRe[j];
+                    bRe[j] = aRe[j] - tr;
+                    bIm[j] = aIm[j] - ti;
+                    aRe[j] += tr;
+                    aIm[j] += ti;
+                }
+            }
+        }
+    }
+};
+
+struct Band {
+    double lowHz;
+    double highHz;
+};
+
+// "50-400,400-2000" into bands, false on a malformed or empty list
+inline bool ParseBands(const std::string& text, std::vector<Band>& bands) {
+    bands.clear();
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        std::string item = text.substr(start, comma - start);
+        size_t dash = item.find('-');
+        if (dash == std::string::npos) {
+            return false;
+        }
+        Band band = { atof(item.substr(0, dash).c_str()), atof(item.substr(dash + 1).c_str()) };
+        if (band.lowHz < 0 || band.highHz <= band.lowHz) {
+            return false;
+        }
+        bands.push_back(band);
+        start = comma + 1;
+    }
+    return !bands.empty();
+}
+
+// Short-circuit transfer, arc and spatter, and the upper audible range
+const char* const DefaultBands = "50-400,400-2000,2000-8000,8000-20000";
+
+// Features of one window, written as one row of <name>_features.csv
+struct FeatureRow {
+    uint64_t firstSample;
+    double rms;
+    double centroidHz;
+    uint32_t clicks;                   // In the hop that starts the window
+    std::vector<double> bandPower;     // Mean square per band, full scale = 1
+};
+
+// Windows of `window` samples every `hop` samples.  RMS and the clicks come
+// from the samples, the band powers and centroid from the Hann-windowed
+// spectrum scaled so the bands add up to the window's mean square.  A click
+// is a sample-to-sample step larger than clickFactor times the recent
+// typical step, at most one per millisecond: the sharp pressure pulse of a
+// short circuit or arc re-ignition.
+class FeatureExtractor {
+public:
+    FeatureExtractor(int sampleRate, size_t windowSamples, size_t hopSamples,
+                     const std::vector<Band>& bandList, double clickThreshold) :
+        rate(sampleRate),
+        hop(hopSamples),
+        fft(windowSamples),
+        bands(bandList),
+        clickFactor(clickThreshold),
+        hann(windowSamples),
+        windowed(windowSamples),
+        power(windowSamples / 2),
+        refractory(sampleRate / 1000 > 0 ? sampleRate / 1000 : 1)
+    {
+        double sumSquares = 0.0;
+        for (size_t i = 0; i < windowSamples; i++) {
+            hann[i] = (float)(0.5 - 0.5 * cos(2.0 * 3.14159265358979323846 * i / windowSamples));
+            sumSquares += (double)hann[i] * hann[i];
+        }
+        powerScale = 2.0 / (windowSamples * sumSquares);
+        for (const Band& band : bands) {
+            size_t low = (size_t)ceil(band.lowHz * windowSamples / rate);
+            size_t high = (size_t)floor(band.highHz * windowSamples / rate);
+            bandBins.push_back(std::make_pair(low < 1 ? 1 : low, high < power.size() ? high : power.size() - 1));
+        }
+    }
+
+    size_t Window() const { return fft.Size(); }
+    size_t Hop() const { return hop; }
+
+    // samples holds Window() samples starting at firstSample
+    void Process(const float* samples, uint64_t firstSample, FeatureRow& row) {
+        size_t n = fft.Size();
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            sum += samples[i];
+            sumSquares += (double)samples[i] * samples[i];
+        }
+        double mean = sum / n;
+        row.firstSample = firstSample;
+        row.rms = sqrt(sumSquares / n);
+        row.clicks = CountClicks(samples, firstSample);
+
+        for (size_t i = 0; i < n; i++) {
+            windowed[i] = (float)((samples[i] - mean) * hann[i]);
+        }
+        fft.Power(windowed.data(), power.data());
+
+        double total = 0.0;
+        double weighted = 0.0;
+        for (size_t k = 1; k < power.size(); k++) {
+            total += power[k];
+            weighted += power[k] * k;
+        }
+        row.centroidHz = total > 0 ? weighted / total * rate / n : 0.0;
+        row.bandPower.resize(bands.size());
+        for (size_t b = 0; b < bands.size(); b++) {
+            double bandSum = 0.0;
+            for (size_t k = bandBins[b].first; k <= bandBins[b].second; k++) {
+                bandSum += power[k];
+            }
+            row.bandPower[b] = bandSum * powerScale;
+        }
+    }
+
+    // A gap in the samples; the click baseline starts over
+    void Restart() {
+        havePrevious = false;
+        baseline = 0.0;
+    }
+
+    uint64_t TotalClicks() const { return totalClicks; }
+
+    void WriteHeader(FILE* file) const {
+        fputs("FirstSample,Seconds,RMS,RMS_dBFS,CentroidHz,Clicks", file);
+        for (const Band& band : bands) {
+            fprintf(file, ",Band_%g_%gHz", band.lowHz, band.highHz);
+        }
+        fputs("\n", file);
+    }
+
+    bool WriteRow(FILE* file, const FeatureRow& row) const {
+        int result = fprintf(file, "%llu,%.6f,%.6g,%.2f,%.1f,%u", (unsigned long long)row.firstSample,
+                             (double)row.firstSample / rate, row.rms,
+                             row.rms > 0 ? 20.0 * log10(row.rms) : -200.0, row.centroidHz, row.clicks);
+        for (double value : row.bandPower) {
+            result = result < 0 ? result : fprintf(file, ",%.6g", value);
+        }
+        return result >= 0 && fputs("\n", file) >= 0;
+    }
+
+private:
+    int rate;
+    size_t hop;
+    RealFft fft;
+    std::vector<Band> bands;
+    std::vector<std::pair<size_t, size_t>> bandBins;
+    double clickFactor;
+    std::vector<float> hann;
+    std::vector<float> windowed;
+    std::vector<double> power;
+    double powerScale;
+    int refractory;                    // Samples after a click before the next can count
+
+    bool havePrevious = false;
+    float previous = 0.0f;
+    double baseline = 0.0;             // Recent RMS of the sample-to-sample steps
+    uint64_t lastClick = 0;
+    uint64_t totalClicks = 0;
+
+    // Each sample is looked at once: only the first hop of every window
+    uint32_t CountClicks(const float* samples, uint64_t firstSample) {
+        uint32_t clicks = 0;
+        double stepSquares = 0.0;
+        size_t count = hop < fft.Size() ? hop : fft.Size();
+        for (size_t i = 0; i < count; i++) {
+            float step = havePrevious ? samples[i] - previous : 0.0f;
+            previous = samples[i];
+            havePrevious = true;
+            stepSquares += (double)step * step;
+            uint64_t index = firstSample + i;
+            if (baseline > 0 && fabs(step) > clickFactor * baseline &&
+                (lastClick == 0 || index - lastClick >= (uint64_t)refractory)) {
+                clicks++;
+                lastClick = index;
+            }
+        }
+        // Follow the level over about half a second, so a louder arc does
+        // not read as a run of clicks
+        double hopRms = sqrt(stepSquares / count);
+        double weight = (double)count / (rate * 0.5);
+        baseline = baseline > 0 ? baseline + (hopRms - baseline) * (weight < 1 ? weight : 1) : hopRms;
+        totalClicks += clicks;
+        return clicks;
+    }
+};
+
+}  // namespace Mic
@@ -0,0 +1,310 @@
+// Arrow IPC file writer for the microphone tools, with the FlatBuffers
+// metadata built by hand the same way as LEMBOXLIB's Arrow output: the
+// magic, a schema message, one record batch per WriteBatch and, on Close,
+// a footer indexing the batches.  Columns are fixed width and never null.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Mic {
+
+struct ArrowColumn {
+    enum class Type { Int, Float, Timestamp };  // Timestamps are nanoseconds, UTC
+
+    const char* name;
+    Type type;
+    size_t width;                               // Bytes per value, 4 or 8 for Float
+    bool isSigned;                              // Int columns only
+};
+
+class ArrowFile {
+public:
+    ArrowFile() = default;
+    ArrowFile(const ArrowFile&) = delete;
+    ArrowFile& operator=(const ArrowFile&) = delete;
+    ~ArrowFile() { Close(); }
+
+    bool Open(const std::string& path, const std::vector<ArrowColumn>& columnList) {
+        static const char magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+        columns = columnList;
+        blocks.clear();
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        offset = 0;
+        if (!WriteBytes(magic, sizeof(magic))) {
+            return false;
+        }
+        size_t headerSlot = StartMessage(HeaderSchema, 0);
+        builder.Link(headerSlot, BuildSchema());
+        return WriteMetadata();
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+
+    // One record batch; data[i] holds count values of column i.  Buffers
+    // are written straight from the caller's arrays, padded to 64 bytes.
+    bool WriteBatch(const std::vector<const void*>& data, size_t count) {
+        if (!file || data.size() != columns.size() || count == 0) {
+            return false;
+        }
+        std::vector<int64_t> bufferOffset(columns.size());
+        int64_t bodyLength = 0;
+        for (size_t i = 0; i < columns.size(); i++) {
+            bufferOffset[i] = bodyLength;
+            bodyLength += (int64_t)Pad(count * columns[i].width);
+        }
+
+        // RecordBatch: one node per column, then a (validity, values) buffer
+        // pair per column with no validity bitmap since nothing is null
+        size_t headerSlot = StartMessage(HeaderRecordBatch, bodyLength);
+        size_t batch = builder.StartTable(3);
+        builder.Put64(builder.Field(0, 8), (int64_t)count);
+        size_t nodesSlot = builder.Field(1, 4);
+        size_t buffersSlot = builder.Field(2, 4);
+        builder.EndTable();
+        builder.Link(headerSlot, batch);
+
+        size_t nodes = builder.Vector(columns.size(), 16, 8);
+        builder.Link(nodesSlot, nodes);
+        for (size_t i = 0; i < columns.size(); i++) {
+            builder.Put64(nodes + 4 + 16 * i, (int64_t)count);
+        }
+        size_t buffers = builder.Vector(2 * columns.size(), 16, 8);
+        builder.Link(buffersSlot, buffers);
+        for (size_t i = 0; i < columns.size(); i++) {
+            builder.Put64(buffers + 4 + 32 * i, bufferOffset[i]);
+            builder.Put64(buffers + 4 + 32 * i + 16, bufferOffset[i]);
+            builder.Put64(buffers + 4 + 32 * i + 24, (int64_t)(count * columns[i].width));
+        }
+
+        Block block;
+        block.offset = (int64_t)offset;
+        if (!WriteMetadata()) {
+            return false;
+        }
+        block.metadataLength = (int32_t)(offset - (uint64_t)block.offset);
+        block.bodyLength = bodyLength;
+        static const unsigned char zeros[64] = {};
+        for (size_t i = 0; i < columns.size(); i++) {
+            size_t bytes = count * columns[i].width;
+            if (!WriteBytes(data[i], bytes) || !WriteBytes(zeros, Pad(bytes) - bytes)) {
+                return false;
+            }
+        }
+        blocks.push_back(block);
+        return true;
+    }
+
+    uint64_t BytesWritten() const { return offset; }
+
+    // The end-of-stream marker and the footer that make the stream a
+    // random-access Arrow file
+    bool Close() {
+        static const char magic[6] = { 'A', 'R', 'R', 'O', 'W', '1' };
+        static const uint32_t endOfStream[2] = { 0xFFFFFFFF, 0 };
+
+        if (!file) {
+            return false;
+        }
+        builder.Clear();
+        size_t root = builder.Reserve(4, 4);
+        size_t footer = builder.StartTable(4);
+        builder.Put16(builder.Field(0, 2), MetadataV5);
+        size_t schemaSlot = builder.Field(1, 4);
+        size_t dictionariesSlot = builder.Field(2, 4);
+        size_t batchesSlot = builder.Field(3, 4);
+        builder.EndTable();
+        builder.Link(root, footer);
+        builder.Link(schemaSlot, BuildSchema());
+        builder.Link(dictionariesSlot, builder.Vector(0, 24, 8));
+        size_t batches = builder.Vector(blocks.size(), 24, 8);
+        builder.Link(batchesSlot, batches);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            builder.Put64(batches + 4 + 24 * i, blocks[i].offset);
+            builder.Put32(batches + 4 + 24 * i + 8, (uint32_t)blocks[i].metadataLength);
+            builder.Put64(batches + 4 + 24 * i + 16, blocks[i].bodyLength);
+        }
+
+        uint32_t footerLength = (uint32_t)builder.data.size();
+        bool ok = WriteBytes(endOfStream, sizeof(endOfStream)) &&
+                  WriteBytes(builder.data.data(), builder.data.size()) &&
+                  WriteBytes(&footerLength, sizeof(footerLength)) &&
+                  WriteBytes(magic, sizeof(magic));
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+private:
+    static const uint16_t MetadataV5 = 4;
+    static const unsigned char HeaderSchema = 1;
+    static const unsigned char HeaderRecordBatch = 3;
+    static const unsigned char TypeInt = 2;
+    static const unsigned char TypeFloatingPoint = 3;
+    static const unsigned char TypeTimestamp = 10;
+    static const uint16_t PrecisionSingle = 1;
+    static const uint16_t PrecisionDouble = 2;
+    static const uint16_t TimeUnitNanosecond = 3;
+
+    // FlatBuffers builder filled front to back: a table's vtable sits just
+    // before it and everything the table points to is appended after it,
+    // so every offset points forward.  Only one table is open at a time.
+    struct Builder {
+        std::vector<unsigned char> data;
+        size_t vtable = 0;
+        size_t table = 0;
+
+        void Clear() { data.clear(); }
+
+        size_t Reserve(size_t bytes, size_t align) {
+            size_t position = (data.size() + align - 1) & ~(align - 1);
+            data.resize(position + bytes, 0);
+            return position;
+        }
+
+        void Put(size_t position, const void* value, size_t bytes) { memcpy(data.data() + position, value, bytes); }
+        void Put8(size_t position, unsigned char value) { Put(position, &value, 1); }
+        void Put16(size_t position, uint16_t value) { Put(position, &value, 2); }
+        void Put32(size_t position, uint32_t value) { Put(position, &value, 4); }
+        void Put64(size_t position, int64_t value) { Put(position, &value, 8); }
+
+        // The vtable goes immediately before its table, returns the table position
+        size_t StartTable(int numFields) {
+            vtable = Reserve(4 + 2 * numFields, 2);
+            Put16(vtable, (uint16_t)(4 + 2 * numFields));
+            table = Reserve(4, 4);
+            Put32(table, (uint32_t)(table - vtable));
+            return table;
+        }
+
+        // Add a field to the open table, returns where its value goes
+        size_t Field(int id, size_t bytes) {
+            size_t position = Reserve(bytes, bytes);
+            Put16(vtable + 4 + 2 * id, (uint16_t)(position - table));
+            return position;
+        }
+
+        void EndTable() { Put16(vtable + 2, (uint16_t)(data.size() - table)); }
+
+        // Point an offset field or vector slot at an object written after it
+        void Link(size_t slot, size_t target) { Put32(slot, (uint32_t)(target - slot)); }
+
+        // Vector header with the elements aligned, returns the position of the count
+        size_t Vector(size_t count, size_t elementSize, size_t align) {
+            while ((data.size() + 4) % align != 0) {
+                Reserve(1, 1);
+            }
+            size_t position = Reserve(4 + count * elementSize, 4);
+            Put32(position, (uint32_t)count);
+            return position;
+        }
+
+        size_t String(const char* text) {
+            size_t length = strlen(text);
+            size_t position = Reserve(4 + length + 1, 4);
+            Put32(position, (uint32_t)length);
+            Put(position + 4, text, length);
+            return position;
+        }
+    };
+
+    struct Block {
+        int64_t offset;
+        int32_t metadataLength;                 // Including the continuation marker and length
+        int64_t bodyLength;
+    };
+
+    FILE* file = nullptr;
+    uint64_t offset = 0;                        // Bytes written so far
+    std::vector<ArrowColumn> columns;
+    std::vector<Block> blocks;
+    Builder builder;
+
+    static size_t Pad(size_t bytes) { return (bytes + 63) & ~(size_t)63; }
+
+    bool WriteBytes(const void* bytes, size_t count) {
+        if (count > 0 && fwrite(bytes, 1, count, file) != count) {
+            return false;
+        }
+        offset += count;
+        return true;
+    }
+
+    size_t BuildSchema() {
+        size_t schema = builder.StartTable(2);
+        size_t fieldsSlot = builder.Field(1, 4);
+        builder.EndTable();
+
+        size_t fields = builder.Vector(columns.size(), 4, 4);
+        builder.Link(fieldsSlot, fields);
+        for (size_t i = 0; i < columns.size(); i++) {
+            const ArrowColumn& column = columns[i];
+            size_t field = builder.StartTable(6);
+            size_t nameSlot = builder.Field(0, 4);
+            unsigned char typeType = column.type == ArrowColumn::Type::Int ? TypeInt :
+                                     column.type == ArrowColumn::Type::Float ? TypeFloatingPoint : TypeTimestamp;
+            builder.Put8(builder.Field(2, 1), typeType);
+            size_t typeSlot = builder.Field(3, 4);
+            size_t childrenSlot = builder.Field(5, 4);
+            builder.EndTable();
+            builder.Link(fields + 4 + 4 * i, field);
+
+            builder.Link(nameSlot, builder.String(column.name));
+            builder.Link(childrenSlot, builder.Vector(0, 4, 4));
+
+            size_t type;
+            if (column.type == ArrowColumn::Type::Int) {
+                type = builder.StartTable(2);
+                builder.Put32(builder.Field(0, 4), (uint32_t)(column.width * 8));
+                builder.Put8(builder.Field(1, 1), column.isSigned ? 1 : 0);
+                builder.EndTable();
+            } else if (column.type == ArrowColumn::Type::Float) {
+                type = builder.StartTable(1);
+                builder.Put16(builder.Field(0, 2), column.width == 4 ? PrecisionSingle : PrecisionDouble);
+                builder.EndTable();
+            } else {
+                type = builder.StartTable(2);
+                builder.Put16(builder.Field(0, 2), TimeUnitNanosecond);
+                size_t timezoneSlot = builder.Field(1, 4);
+                builder.EndTable();
+                builder.Link(timezoneSlot, builder.String("UTC"));
+            }
+            builder.Link(typeSlot, type);
+        }
+        return schema;
+    }
+
+    // Message table; the header is built by the caller, returns the header slot
+    size_t StartMessage(unsigned char headerType, int64_t bodyLength) {
+        builder.Clear();
+        size_t root = builder.Reserve(4, 4);
+        size_t message = builder.StartTable(4);
+        builder.Put16(builder.Field(0, 2), MetadataV5);
+        builder.Put8(builder.Field(1, 1), headerType);
+        size_t headerSlot = builder.Field(2, 4);
+        builder.Put64(builder.Field(3, 8), bodyLength);
+        builder.EndTable();
+        builder.Link(root, message);
+        return headerSlot;
+    }
+
+    // The built metadata with its continuation marker and length, padded so
+    // the body that follows starts on a 64-byte file offset; with bodies in
+    // whole 64-byte multiples every buffer is then 64-byte aligned in the file
+    bool WriteMetadata() {
+        uint64_t end = (offset + 8 + builder.data.size() + 63) & ~(uint64_t)63;
+        builder.Reserve((size_t)(end - offset - 8 - builder.data.size()), 1);
+        uint32_t prefix[2] = { 0xFFFFFFFF, (uint32_t)builder.data.size() };
+        return WriteBytes(prefix, sizeof(prefix)) && WriteBytes(builder.data.data(), builder.data.size());
+    }
+};
+
+}  // namespace Mic
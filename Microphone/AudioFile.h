@@ -0,0 +1,321 @@
+// Output files of the native microphone recorder: the audio itself as WAV
+// (float32), FLAC (24-bit) or raw float32 by extension, and the binary
+// sidecar with one timing record per hardware buffer.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef MIC_FLAC
+#include <FLAC/stream_encoder.h>
+#endif
+
+namespace Mic {
+
+// <audio path without extension><suffix>, for the files written next to it
+inline std::string SidecarPath(const std::string& audioPath, const char* suffix) {
+    size_t dot = audioPath.find_last_of('.');
+    size_t slash = audioPath.find_last_of("/\\");
+    std::string stem = (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        ? audioPath : audioPath.substr(0, dot);
+    return stem + suffix;
+}
+
+// Audio samples, interleaved by channel.  WAV files keep their header sizes
+// up to date on every Flush, so a file cut short by a crash still opens,
+// and switch to RF64 when the data outgrows 4 GB.
+class AudioFile {
+public:
+    enum class Format { Raw, Wav, Flac };
+
+    AudioFile() = default;
+    AudioFile(const AudioFile&) = delete;
+    AudioFile& operator=(const AudioFile&) = delete;
+    ~AudioFile() { Close(); }
+
+    static Format FormatOf(const std::string& path) {
+        std::string extension = Extension(path);
+        if (extension == ".wav") return Format::Wav;
+        if (extension == ".flac") return Format::Flac;
+        return Format::Raw;
+    }
+
+    static bool FlacAvailable() {
+#ifdef MIC_FLAC
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool Open(const std::string& path, int sampleRate, int channelCount) {
+        format = FormatOf(path);
+        rate = sampleRate;
+        channels = channelCount;
+        dataBytes = 0;
+        clipped = 0;
+        if (format == Format::Flac) {
+            return OpenFlac(path);
+        }
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        return format != Format::Wav || WriteWavHeader();
+    }
+
+    bool IsOpen() const {
+#ifdef MIC_FLAC
+        if (encoder) {
+            return true;
+        }
+#endif
+        return file != nullptr;
+    }
+
+    bool Write(const float* samples, size_t count) {
+#ifdef MIC_FLAC
+        if (encoder) {
+            return WriteFlac(samples, count);
+        }
+#endif
+        if (fwrite(samples, sizeof(float), count, file) != count) {
+            return false;
+        }
+        dataBytes += count * sizeof(float);
+        return true;
+    }
+
+    // Push buffered data to the OS and bring the WAV header up to date
+    void Flush() {
+        if (!file) {
+            return;
+        }
+        if (format == Format::Wav) {
+            UpdateWavHeader();
+        }
+        fflush(file);
+    }
+
+    void Close() {
+#ifdef MIC_FLAC
+        if (encoder) {
+            FLAC__stream_encoder_finish(encoder);
+            FLAC__stream_encoder_delete(encoder);
+            encoder = nullptr;
+        }
+#endif
+        if (file) {
+            Flush();
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    // Samples beyond full scale, clamped in FLAC files
+    uint64_t Clipped() const { return clipped; }
+
+private:
+    FILE* file = nullptr;
+    Format format = Format::Raw;
+    int rate = 0;
+    int channels = 1;
+    uint64_t dataBytes = 0;
+    uint64_t clipped = 0;
+
+    static const uint32_t WavFloat = 3;         // WAVE_FORMAT_IEEE_FLOAT
+    static const long Ds64Offset = 12;          // JUNK chunk that becomes ds64
+    static const long HeaderBytes = 12 + 36 + 8 + 18 + 12 + 8;
+
+    static std::string Extension(const std::string& path) {
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return "";
+        }
+        std::string extension = path.substr(dot);
+        for (char& c : extension) {
+            c = (char)tolower((unsigned char)c);
+        }
+        return extension;
+    }
+
+    void Put32(unsigned char* at, uint32_t value) {
+        for (int i = 0; i < 4; i++) at[i] = (unsigned char)(value >> (8 * i));
+    }
+
+    void Put64(unsigned char* at, uint64_t value) {
+        for (int i = 0; i < 8; i++) at[i] = (unsigned char)(value >> (8 * i));
+    }
+
+    // RIFF, a JUNK chunk reserving room for ds64, fmt (float, with cbSize
+    // and a fact chunk as the spec asks for non-PCM data), then data
+    bool WriteWavHeader() {
+        unsigned char header[HeaderBytes] = {};
+        unsigned char* at = header;
+        memcpy(at, "RIFF", 4); Put32(at + 4, 0); memcpy(at + 8, "WAVE", 4); at += 12;
+        memcpy(at, "JUNK", 4); Put32(at + 4, 28); at += 36;
+        memcpy(at, "fmt ", 4); Put32(at + 4, 18); at += 8;
+        at[0] = (unsigned char)WavFloat;
+        at[2] = (unsigned char)channels;
+        Put32(at + 4, (uint32_t)rate);
+        Put32(at + 8, (uint32_t)(rate * channels * sizeof(float)));
+        at[12] = (unsigned char)(channels * sizeof(float));
+        at[14] = 32;
+        at += 18;
+        memcpy(at, "fact", 4); Put32(at + 4, 4); Put32(at + 8, 0); at += 12;
+        memcpy(at, "data", 4); Put32(at + 4, 0);
+        return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    }
+
+    void UpdateWavHeader() {
+        uint64_t riffBytes = HeaderBytes - 8 + dataBytes;
+        uint64_t frames = dataBytes / (sizeof(float) * channels);
+        bool rf64 = riffBytes > 0xFFFFFFFFull;
+        unsigned char size[4];
+        unsigned char ds64[36];
+
+        fflush(file);
+        if (rf64) {
+            // Sizes move to the ds64 chunk and the 32-bit fields read -1
+            memcpy(ds64, "ds64", 4);
+            Put32(ds64 + 4, 28);
+            Put64(ds64 + 8, riffBytes);
+            Put64(ds64 + 16, dataBytes);
+            Put64(ds64 + 24, frames);
+            Put32(ds64 + 32, 0);
+            fseek(file, 0, SEEK_SET);
+            fwrite("RF64", 1, 4, file);
+            fseek(file, Ds64Offset, SEEK_SET);
+            fwrite(ds64, 1, sizeof(ds64), file);
+        }
+        Put32(size, rf64 ? 0xFFFFFFFFu : (uint32_t)riffBytes);
+        fseek(file, 4, SEEK_SET);
+        fwrite(size, 1, 4, file);
+        Put32(size, rf64 ? 0xFFFFFFFFu : (uint32_t)frames);
+        fseek(file, HeaderBytes - 12, SEEK_SET);
+        fwrite(size, 1, 4, file);
+        Put32(size, rf64 ? 0xFFFFFFFFu : (uint32_t)dataBytes);
+        fseek(file, HeaderBytes - 4, SEEK_SET);
+        fwrite(size, 1, 4, file);
+        fseek(file, 0, SEEK_END);
+    }
+
+#ifdef MIC_FLAC
+    FLAC__StreamEncoder* encoder = nullptr;
+    std::vector<FLAC__int32> converted;
+
+    bool OpenFlac(const std::string& path) {
+        encoder = FLAC__stream_encoder_new();
+        if (!encoder) {
+            return false;
+        }
+        FLAC__stream_encoder_set_channels(encoder, channels);
+        FLAC__stream_encoder_set_bits_per_sample(encoder, 24);
+        FLAC__stream_encoder_set_sample_rate(encoder, rate);
+        FLAC__stream_encoder_set_compression_level(encoder, 5);
+        if (FLAC__stream_encoder_init_file(encoder, path.c_str(), nullptr, nullptr) !=
+            FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+            FLAC__stream_encoder_delete(encoder);
+            encoder = nullptr;
+            return false;
+        }
+        converted.resize(1 << 16);
+        return true;
+    }
+
+    // FLAC holds integers, so full scale maps to the 24-bit range
+    bool WriteFlac(const float* samples, size_t count) {
+        while (count > 0) {
+            size_t block = count < converted.size() ? count : converted.size();
+            block -= block % channels;
+            for (size_t i = 0; i < block; i++) {
+                float value = samples[i];
+                if (value > 1.0f || value < -1.0f) {
+                    clipped++;
+                    value = value > 0 ? 1.0f : -1.0f;
+                }
+                converted[i] = (FLAC__int32)(value * 8388607.0f);
+            }
+            if (!FLAC__stream_encoder_process_interleaved(encoder, converted.data(), (unsigned)(block / channels))) {
+                return false;
+            }
+            dataBytes += block * 3;
+            samples += block;
+            count -= block;
+        }
+        return true;
+    }
+#else
+    bool OpenFlac(const std::string&) {
+        return false;
+    }
+#endif
+};
+
+// One hardware buffer in the timing sidecar
+struct ChunkTiming {
+    int64_t sampleIndex;                        // First frame of the buffer in the audio file
+    int64_t deviceIndex;                        // The same counting dropped frames
+    int64_t frames;
+    int64_t status;                             // Input overflow flags from the driver
+    int64_t unixTimeNs;                         // Host time the buffer was delivered
+    double adcTime;                             // Stream clock time of the first frame, seconds
+    int64_t correctedUnixNs;                    // First frame on the fitted device clock
+};
+
+// The sidecar: "MICCHNK1", a uint32 header length, a header of
+// "rate=48000,channels=1;sample_index:i8,device_index:i8,..." and then
+// one fixed 56-byte record per buffer, little-endian as written on x86.
+class ChunkFile {
+public:
+    ~ChunkFile() { Close(); }
+
+    static std::string PathFor(const std::string& audioPath) {
+        return SidecarPath(audioPath, "_chunks.bin");
+    }
+
+    bool Open(const std::string& path, int rate, int channels) {
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        char header[256];
+        int length = snprintf(header, sizeof(header),
+                              "rate=%d,channels=%d;sample_index:i8,device_index:i8,frames:i8,status:i8,"
+                              "unix_time_ns:i8,adc_time:f8,corrected_unix_ns:i8",
+                              rate, channels);
+        uint32_t headerLength = (uint32_t)length;
+        return fwrite("MICCHNK1", 1, 8, file) == 8 &&
+               fwrite(&headerLength, sizeof(headerLength), 1, file) == 1 &&
+               fwrite(header, 1, headerLength, file) == headerLength;
+    }
+
+    bool Write(const ChunkTiming& record) {
+        return fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+
+    void Flush() {
+        if (file) {
+            fflush(file);
+        }
+    }
+
+    void Close() {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+private:
+    FILE* file = nullptr;
+};
+
+static_assert(sizeof(ChunkTiming) == 56, "sidecar records are seven 8-byte columns");
+
+}  // namespace Mic
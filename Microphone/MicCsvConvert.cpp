@@ -0,0 +1,586 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArrowFile.h"
+#include "AudioFile.h"
+#include "RSICommon.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// RATE and CHUNK of Microphone.py, which the legacy files were recorded with
+const int DefaultRate = 48000;
+const int DefaultChunk = 1024;
+
+// Rows per Arrow record batch
+const size_t ArrowBatchRows = 1 << 20;
+
+// Read-only view of a whole file, so the parser threads work straight on
+// the page cache without copying it through read buffers
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& path) {
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER fileSize;
+        if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+            return false;
+        }
+        mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            return false;
+        }
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        descriptor = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0) {
+            return false;
+        }
+        void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view == MAP_FAILED) {
+            return false;
+        }
+        madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL);
+        madvise(view, (size_t)status.st_size, MADV_WILLNEED);
+        data = (const char*)view;
+        size = (size_t)status.st_size;
+#endif
+        return data != nullptr;
+    }
+
+    const char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        mapping = nullptr;
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (descriptor >= 0) close(descriptor);
+        descriptor = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+static inline int LowestSetByte(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, mask);
+    return (int)bit / 8;
+#else
+    return __builtin_ctzll(mask) / 8;
+#endif
+}
+
+// The run of up to eight ASCII digits at p, eight bytes at a time in one
+// register: find the first byte that is not a digit, shift the digits to
+// the top so the bytes shifted in read as leading zeros, and combine them
+// pairwise (2 -> 4 -> 8 digits) in three multiplies.
+static inline uint32_t ParseDigits(const char* p, const char* end, int& count) {
+    uint64_t x = 0;
+    if (end - p >= 8) {
+        memcpy(&x, p, 8);
+    } else if (end > p) {
+        memcpy(&x, p, (size_t)(end - p));      // Zero bytes past the end are not digits
+    }
+    uint64_t highNibble = (x & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull;
+    uint64_t over9 = ((x & 0x0F0F0F0F0F0F0F0Full) + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull;
+    uint64_t notDigit = highNibble | over9;
+    count = notDigit ? LowestSetByte(notDigit) : 8;
+    if (count == 0) {
+        return 0;
+    }
+    x <<= 8 * (8 - count);
+    x = ((x & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+    x = ((x & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+    return (uint32_t)(((x & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32);
+}
+
+// A plain decimal as _save_data writes it ("%.6f"), false for anything
+// else (exponents, nan, more than eight digits either side) so the caller
+// can fall back to strtod
+static inline bool ParseFixed(const char*& p, const char* end, double& value) {
+    static const double scale[9] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        s++;
+    }
+    int integerDigits;
+    uint32_t integer = ParseDigits(s, end, integerDigits);
+    s += integerDigits;
+    int fractionDigits = 0;
+    uint32_t fraction = 0;
+    if (s < end && *s == '.') {
+        s++;
+        fraction = ParseDigits(s, end, fractionDigits);
+        s += fractionDigits;
+    }
+    if (integerDigits + fractionDigits == 0 || integerDigits == 8 || fractionDigits == 8 ||
+        (s < end && (*s == 'e' || *s == 'E'))) {
+        return false;
+    }
+    value = integer + fraction / scale[fractionDigits];
+    if (negative) {
+        value = -value;
+    }
+    p = s;
+    return true;
+}
+
+// One row: relative time, absolute time (skipped, it is start + relative)
+// and amplitude.  p is moved past the line ending.  Nothing is looked for
+// beyond the line, so a malformed row never takes the next one with it.
+static bool ParseRow(const char*& p, const char* end, double& relative, float& amplitude) {
+    const char* newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+    const char* lineEnd = newline ? newline : end;
+    const char* next = newline ? newline + 1 : end;
+    const char* s = p;
+    double value = 0.0;
+    bool ok = ParseFixed(s, lineEnd, relative) && s < lineEnd && *s == ',';
+    if (ok) {
+        // "YYYY-mm-dd HH:MM:SS.ffffff" is 26 characters
+        s++;
+        if (lineEnd - s > 26 && s[26] == ',') {
+            s += 27;
+        } else {
+            const char* comma = (const char*)memchr(s, ',', (size_t)(lineEnd - s));
+            ok = comma != nullptr;
+            s = ok ? comma + 1 : s;
+        }
+    }
+    ok = ok && ParseFixed(s, lineEnd, value) && (s == lineEnd || *s == '\r');
+    if (!ok) {
+        // Anything unusual goes through strtod on a terminated copy
+        char line[256];
+        size_t length = std::min((size_t)(lineEnd - p), sizeof(line) - 1);
+        memcpy(line, p, length);
+        line[length] = '\0';
+        char* field = nullptr;
+        relative = strtod(line, &field);
+        char* second = field && *field == ',' ? strchr(field + 1, ',') : nullptr;
+        char* last = nullptr;
+        value = second ? strtod(second + 1, &last) : 0.0;
+        ok = field != line && second && last != second + 1;
+    }
+    amplitude = (float)value;
+    p = next;
+    return ok;
+}
+
+// First sample of a callback buffer, recognized by its relative time not
+// following on from the previous sample's
+struct ChunkStart {
+    uint64_t row;
+    double relative;
+};
+
+// The rows of one slice of the file, parsed on its own thread
+struct Slice {
+    const char* begin;
+    const char* end;
+    std::vector<float> amplitude;
+    std::vector<double> relative;              // Only kept for Arrow output
+    std::vector<ChunkStart> chunkStarts;       // From the second row of the slice on
+    double firstRelative = 0.0;
+    double lastRelative = 0.0;
+    uint64_t badLines = 0;
+};
+
+// Converts the microphone_data.csv files that Microphone.py's _save_data
+// wrote (a start time line, a column header, then relative time, absolute
+// time and amplitude per sample) into an audio file and timing sidecar
+// like MicRecorder's, or an Arrow file.  The CSV is memory-mapped and cut
+// at line boundaries into one slice per thread; each thread parses its
+// slice's numbers eight digits at a time (ParseDigits) and notes where a
+// new callback buffer starts.  The main thread takes the slices in order as
+// they finish, so writing the first overlaps parsing the rest.
+//
+// _save_data gave every buffer's first sample its callback time and the
+// rest 1/rate steps from there, so a step that is not 1/rate (within the
+// rounding of six decimals) marks a buffer.  A callback that came exactly
+// one buffer after the previous one leaves no mark, so runs longer than the
+// buffer size are split back into buffers.  The callback times go through
+// ClockFit like the native recorder's, giving the sidecar's corrected times.
+class CsvConverter {
+public:
+    CsvConverter(int sampleRate, int chunkFrames, int threadCount) :
+        rate(sampleRate),
+        chunk(chunkFrames),
+        threads(threadCount),
+        clock(50, 120, 1e9 / sampleRate) { }
+
+    bool Open(const std::string& path) {
+        if (!csv.Open(path)) {
+            return false;
+        }
+        const char* p = csv.Data();
+        const char* end = p + csv.Size();
+        const char* firstLine = (const char*)memchr(p, '\n', csv.Size());
+        const char* secondLine = firstLine ? (const char*)memchr(firstLine + 1, '\n', (size_t)(end - firstLine - 1)) : nullptr;
+        if (!secondLine || !ParseStartTime(std::string(p, firstLine))) {
+            return false;
+        }
+        body = secondLine + 1;
+        return true;
+    }
+
+    // Local time of the "Recording Start Time" line
+    const char* StartTimeText() const { return startText.c_str(); }
+
+    bool OpenAudio(const std::string& path) {
+        return audio.Open(path, rate, 1) && timing.Open(Mic::ChunkFile::PathFor(path), rate, 1);
+    }
+
+    bool OpenArrow(const std::string& path) {
+        arrowOutput = true;
+        return arrow.Open(path, {
+            { "sample", Mic::ArrowColumn::Type::Int, 8, true },
+            { "relative_time", Mic::ArrowColumn::Type::Float, 8, false },
+            { "timestamp", Mic::ArrowColumn::Type::Timestamp, 8, false },
+            { "amplitude", Mic::ArrowColumn::Type::Float, 4, false },
+        });
+    }
+
+    bool Convert() {
+        const char* end = csv.Data() + csv.Size();
+        size_t bytes = (size_t)(end - body);
+        size_t count = (size_t)threads;
+        if (count > bytes / (1 << 20) + 1) {
+            count = bytes / (1 << 20) + 1;
+        }
+        std::vector<Slice> slices(count);
+        const char* begin = body;
+        for (size_t i = 0; i < count; i++) {
+            const char* cut = i + 1 == count ? end : body + bytes / count * (i + 1);
+            if (cut < begin) {
+                cut = begin;
+            }
+            if (cut < end) {
+                const char* newline = (const char*)memchr(cut, '\n', (size_t)(end - cut));
+                cut = newline ? newline + 1 : end;
+            }
+            slices[i].begin = begin;
+            slices[i].end = cut;
+            begin = cut;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < count; i++) {
+            workers.emplace_back(&CsvConverter::ParseSlice, this, std::ref(slices[i]));
+        }
+        bool ok = true;
+        for (size_t i = 0; i < count; i++) {
+            workers[i].join();
+            ok = WriteSlice(slices[i]) && ok;
+            slices[i] = Slice();
+        }
+        ok = WriteChunk(rows) && ok;
+        ok = CloseOutputs() && ok;
+        return ok;
+    }
+
+    void PrintSummary(double seconds) const {
+        double megabytes = csv.Size() / 1e6;
+        printf("ROWS:%llu\n", (unsigned long long)rows);
+        printf("BAD_LINES:%llu\n", (unsigned long long)badLines);
+        printf("CHUNKS:%llu\n", (unsigned long long)chunks);
+        printf("DURATION_S:%.3f\n", (double)rows / rate);
+        printf("START_TIME:%s\n", startText.c_str());
+        printf("INPUT_MB:%.1f\n", megabytes);
+        printf("SECONDS:%.3f\n", seconds);
+        printf("MB_PER_S:%.1f\n", seconds > 0 ? megabytes / seconds : 0.0);
+        if (!arrowOutput) {
+            printf("CLOCK:drift_ppm=%.3f,fits=%llu,outliers=%llu,resets=%llu\n", clock.DriftPpm(),
+                   (unsigned long long)clock.fits, (unsigned long long)clock.outliers,
+                   (unsigned long long)clock.resets);
+        }
+        if (audio.Clipped() > 0) {
+            printf("CLIPPED:%llu\n", (unsigned long long)audio.Clipped());
+        }
+    }
+
+private:
+    int rate;
+    int chunk;
+    int threads;
+    MappedFile csv;
+    const char* body = nullptr;
+    std::string startText;
+    int64_t startUnixNs = 0;
+
+    Mic::AudioFile audio;
+    Mic::ChunkFile timing;
+    Mic::ArrowFile arrow;
+    bool arrowOutput = false;
+    RSI::ClockFit clock;
+
+    uint64_t rows = 0;
+    uint64_t badLines = 0;
+    uint64_t chunks = 0;
+    bool haveRow = false;
+    double lastRelative = 0.0;
+    uint64_t chunkRow = 0;                     // Open buffer, written when the next one starts
+    double chunkRelative = 0.0;
+
+    bool IsNewChunk(double previous, double relative) const {
+        return fabs(relative - previous - 1.0 / rate) > 2e-6;
+    }
+
+    // "Recording Start Time,2024-05-01 10:00:00.123456", local time
+    bool ParseStartTime(const std::string& line) {
+        size_t comma = line.find(',');
+        if (comma == std::string::npos) {
+            return false;
+        }
+        startText = line.substr(comma + 1);
+        while (!startText.empty() && (startText.back() == '\r' || startText.back() == ' ')) {
+            startText.pop_back();
+        }
+        tm local = {};
+        int micros = 0;
+        if (sscanf(startText.c_str(), "%d-%d-%d %d:%d:%d.%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+                   &local.tm_hour, &local.tm_min, &local.tm_sec, &micros) < 6) {
+            return false;
+        }
+        local.tm_year -= 1900;
+        local.tm_mon -= 1;
+        local.tm_isdst = -1;
+        time_t seconds = mktime(&local);
+        if (seconds == (time_t)-1) {
+            return false;
+        }
+        startUnixNs = (int64_t)seconds * 1000000000 + (int64_t)micros * 1000;
+        return true;
+    }
+
+    void ParseSlice(Slice& slice) {
+        size_t estimate = (size_t)(slice.end - slice.begin) / 40 + 1;
+        slice.amplitude.reserve(estimate);
+        if (arrowOutput) {
+            slice.relative.reserve(estimate);
+        }
+        const char* p = slice.begin;
+        bool first = true;
+        double previous = 0.0;
+        while (p < slice.end) {
+            double relative;
+            float amplitude;
+            if (*p == '\r' || *p == '\n') {
+                p++;
+                continue;
+            }
+            if (!ParseRow(p, slice.end, relative, amplitude)) {
+                slice.badLines++;
+                continue;
+            }
+            if (first) {
+                slice.firstRelative = relative;
+                first = false;
+            } else if (IsNewChunk(previous, relative)) {
+                slice.chunkStarts.push_back({ (uint64_t)slice.amplitude.size(), relative });
+            }
+            previous = relative;
+            slice.amplitude.push_back(amplitude);
+            if (arrowOutput) {
+                slice.relative.push_back(relative);
+            }
+        }
+        slice.lastRelative = previous;
+    }
+
+    bool WriteSlice(const Slice& slice) {
+        badLines += slice.badLines;
+        size_t count = slice.amplitude.size();
+        if (count == 0) {
+            return true;
+        }
+        bool ok = true;
+        if (!haveRow) {
+            chunkRow = 0;
+            chunkRelative = slice.firstRelative;
+            haveRow = true;
+        } else if (IsNewChunk(lastRelative, slice.firstRelative)) {
+            ok = WriteChunk(rows) && ok;
+            chunkRelative = slice.firstRelative;
+        }
+        for (const ChunkStart& start : slice.chunkStarts) {
+            ok = WriteChunk(rows + start.row) && ok;
+            chunkRelative = start.relative;
+        }
+
+        if (arrowOutput) {
+            ok = WriteArrow(slice) && ok;
+        } else {
+            ok = audio.Write(slice.amplitude.data(), count) && ok;
+        }
+        rows += count;
+        lastRelative = slice.lastRelative;
+        return ok;
+    }
+
+    // The open buffer, which ends at endRow.  Its callback time is the
+    // delivery time; the capture of its first frame was a buffer earlier.
+    bool WriteChunk(uint64_t endRow) {
+        bool ok = true;
+        while (endRow > chunkRow) {
+            int64_t frames = (int64_t)(endRow - chunkRow);
+            if (frames > chunk) {
+                frames = chunk;
+            }
+            chunks++;
+            if (!arrowOutput) {
+                Mic::ChunkTiming entry;
+                entry.sampleIndex = (int64_t)chunkRow;
+                entry.deviceIndex = (int64_t)chunkRow;
+                entry.frames = frames;
+                entry.status = 0;
+                entry.unixTimeNs = startUnixNs + llround(chunkRelative * 1e9);
+                entry.adcTime = 0.0;
+                entry.correctedUnixNs = clock.Add((int64_t)chunkRow, entry.unixTimeNs - frames * 1000000000 / rate);
+                ok = timing.Write(entry) && ok;
+            }
+            chunkRow += frames;
+            chunkRelative += (double)frames / rate;
+        }
+        return ok;
+    }
+
+    bool WriteArrow(const Slice& slice) {
+        std::vector<int64_t> sample;
+        std::vector<int64_t> timestamp;
+        bool ok = true;
+        for (size_t first = 0; first < slice.amplitude.size(); first += ArrowBatchRows) {
+            size_t count = std::min(ArrowBatchRows, slice.amplitude.size() - first);
+            sample.resize(count);
+            timestamp.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                sample[i] = (int64_t)(rows + first + i);
+                timestamp[i] = startUnixNs + llround(slice.relative[first + i] * 1e9);
+            }
+            ok = arrow.WriteBatch({ sample.data(), slice.relative.data() + first, timestamp.data(),
+                                    slice.amplitude.data() + first }, count) && ok;
+        }
+        return ok;
+    }
+
+    bool CloseOutputs() {
+        if (arrowOutput) {
+            return arrow.Close();
+        }
+        audio.Close();
+        timing.Close();
+        return true;
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  <microphone_data.csv> [options]  Convert a CSV written by Microphone.py's _save_data\n"
+              << "  Options:\n"
+              << "    --out <file>             .wav float32 (default), .flac 24-bit, .arrow, anything else\n"
+              << "                             raw float32; all but .arrow also get <name>_chunks.bin\n"
+              << "    --threads <n>            Parser threads (default all cores)\n"
+              << "    --rate <hz>              Sample rate of the recording (default " << DefaultRate << ")\n"
+              << "    --chunk <frames>         Frames per callback buffer (default " << DefaultChunk << ")\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string inputPath = argv[1];
+    std::string outputPath = Mic::SidecarPath(inputPath, ".wav");
+    int threads = (int)std::thread::hardware_concurrency();
+    int rate = DefaultRate;
+    int chunk = DefaultChunk;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc) rate = atoi(argv[++i]);
+        else if (arg == "--chunk" && i + 1 < argc) chunk = atoi(argv[++i]);
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+    if (rate <= 0 || chunk <= 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    bool arrowOutput = outputPath.size() >= 6 && outputPath.compare(outputPath.size() - 6, 6, ".arrow") == 0;
+    if (!arrowOutput && Mic::AudioFile::FormatOf(outputPath) == Mic::AudioFile::Format::Flac &&
+        !Mic::AudioFile::FlacAvailable()) {
+        std::cout << "ERROR:NO_FLAC built without libFLAC, use .wav" << std::endl;
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    CsvConverter converter(rate, chunk, threads);
+    if (!converter.Open(inputPath)) {
+        std::cout << "ERROR:BAD_INPUT " << inputPath << " is not a Microphone.py CSV" << std::endl;
+        return 1;
+    }
+    if (arrowOutput ? !converter.OpenArrow(outputPath) : !converter.OpenAudio(outputPath)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "Converting " << inputPath << " to " << outputPath << std::endl;
+    bool ok = converter.Convert();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    converter.PrintSummary(seconds);
+    if (!ok) {
+        std::cout << "ERROR:WRITE_FAILED " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "OK:CONVERT_COMPLETE" << std::endl;
+    return 0;
+}
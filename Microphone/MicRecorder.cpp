@@ -0,0 +1,976 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AcousticFeatures.h"
+#include "AudioFile.h"
+#include "RSICommon.h"
+
+#ifdef MIC_PORTAUDIO
+#include <portaudio.h>
+#endif
+
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Defaults of Microphone.py
+const char* const DefaultDevice = "485B39";
+const int DefaultHostApi = 1;                  // DirectSound on Windows
+const int DefaultRate = 48000;
+const int DefaultChunk = 1024;
+const int MaxChannels = 32;
+
+// One hardware buffer as it waits for the writer
+struct ChunkRecord {
+    uint64_t sampleIndex;                      // First sample of the buffer in the output file
+    uint64_t deviceIndex;                      // The same counting dropped buffers, the device clock
+    uint32_t frames;
+    uint32_t status;                           // Input overflow flags from the driver
+    int64_t hostNs;                            // HostClock time the buffer was delivered
+    int64_t captureNs;                         // HostClock estimate of its first frame's capture
+    double adcTime;                            // Stream time of its first frame
+};
+
+// Samples on their way from the writer to the feature thread
+struct FeatureBlock {
+    uint64_t firstSample;
+    uint32_t count;
+    float samples[1024];
+};
+
+static std::atomic<bool> stopRequested(false);
+
+static void HandleStopSignal(int) {
+    stopRequested = true;
+}
+
+// Records a microphone to WAV, FLAC or raw float32 while it runs.  The
+// audio callback copies each buffer, channels interleaved as the driver
+// delivers them, into a lock-free sample ring and queues
+// a chunk record with its host and device clock times; a writer thread
+// streams the ring to the audio file and the chunk records to the binary
+// sidecar.  Memory use does not grow with the length of the run and
+// stopping only waits for the ring to drain.  Several channels go to one
+// interleaved file, or with --split-channels to a mono file per channel;
+// the writer only ever takes whole frames from the ring.
+//
+// The device's sample count is its own clock.  The writer fits it to host
+// time the way the RSI receiver fits the IPOC (ClockFit): each buffer's
+// capture time, from the driver's ADC time when it gives one and otherwise
+// the callback time less the buffer length, is a late-only observation of
+// the sample count, and the floor line through them gives every sample a
+// host time free of callback jitter, with the device's drift as its slope.
+//
+// With --features the writer also hands the samples to a feature thread
+// (AcousticFeatures.h) that writes RMS, band powers, spectral centroid and
+// short-circuit clicks per window of one channel to <name>_features.csv.  If it falls a
+// ring behind, blocks are dropped there and the windows start over after
+// the gap; the audio file is never held up.
+class MicRecorder {
+private:
+    RSI::SpscRing<float> samples;
+    RSI::SpscRing<ChunkRecord> chunks;
+    Mic::AudioFile audio;
+    Mic::ChunkFile timing;
+    std::vector<std::unique_ptr<Mic::AudioFile>> channelFiles;  // --split-channels
+    std::vector<float> channelScratch;
+    int rate;
+    int chunkFrames;
+    int channels;
+    std::atomic<bool> running;                 // Source delivering buffers
+    std::atomic<bool> writing;                 // Writer may still get more
+    std::atomic<uint64_t> received;            // Frames delivered by the source
+    std::atomic<uint64_t> queued;              // Frames that made it into the ring
+    std::atomic<uint64_t> droppedSamples;      // Frames
+    std::atomic<uint64_t> droppedChunks;
+    std::atomic<uint64_t> overflows;
+    std::atomic<uint64_t> written;             // Frames
+    uint64_t writeErrors;
+    int64_t startNs;
+    int64_t stopNs;
+    RSI::LatencyHistogram callbackTime;        // Time spent in the callback
+    RSI::LatencyHistogram callbackGap;         // Between successive callbacks
+    RSI::ClockFit clock;
+    std::atomic<double> liveDriftPpm;
+    std::atomic<uint64_t> adcStamped;          // Buffers whose capture time came from the ADC time
+    double clockPpm;                           // Synthetic source's device clock error
+    double speed;                              // Synthetic source's pace, 0 = as fast as the writer takes it
+    int64_t lastCallbackNs;
+    std::atomic<float> livePeak;
+
+#ifdef MIC_PORTAUDIO
+    PaStream* stream;
+#endif
+    std::thread synthetic;
+    uint64_t syntheticClicks;
+
+    std::unique_ptr<Mic::FeatureExtractor> features;
+    int featureChannel;
+    std::vector<float> featureScratch;
+    RSI::SpscRing<FeatureBlock> featureRing;
+    FILE* featureFile;
+    std::thread featureThread;
+    std::atomic<bool> featuring;
+    std::atomic<uint64_t> featureWindows;
+    std::atomic<uint64_t> featureDropped;      // Samples the feature thread never saw
+    uint64_t featureGaps;
+    std::atomic<uint64_t> liveClicks;
+
+public:
+    MicRecorder(size_t ringSamples, int sampleRate, int framesPerChunk, int channelCount) :
+        samples(ringSamples),
+        chunks(RecordCapacity(ringSamples, channelCount)),
+        rate(sampleRate),
+        chunkFrames(framesPerChunk),
+        channels(channelCount),
+        running(false),
+        writing(false),
+        received(0),
+        queued(0),
+        droppedSamples(0),
+        droppedChunks(0),
+        overflows(0),
+        written(0),
+        writeErrors(0),
+        startNs(0),
+        stopNs(0),
+        callbackGap(1000000),
+        clock(ClockBlockBuffers, ClockWindowBlocks, 1e9 / sampleRate),
+        liveDriftPpm(0.0),
+        adcStamped(0),
+        clockPpm(0.0),
+        speed(1.0),
+        lastCallbackNs(0),
+        livePeak(0.0f),
+#ifdef MIC_PORTAUDIO
+        stream(nullptr),
+#endif
+        syntheticClicks(0),
+        featureChannel(0),
+        featureRing(FeatureRingBlocks),
+        featureFile(nullptr),
+        featuring(false),
+        featureWindows(0),
+        featureDropped(0),
+        featureGaps(0),
+        liveClicks(0)
+    { }
+
+    ~MicRecorder() {
+        if (featureFile) {
+            fclose(featureFile);
+        }
+    }
+
+    // Synthetic source only: run its sample clock ppm fast (negative slow)
+    void SetClockPpm(double ppm) { clockPpm = ppm; }
+
+    // Synthetic source only: deliver buffers this many times faster than
+    // real time, 0 as fast as the ring has room, for throughput tests
+    void SetSpeed(double factor) { speed = factor; }
+
+    // Audio to path, or with split to <path without extension>_ch1.<ext>
+    // and so on, the chunk times to <path without extension>_chunks.bin
+    bool OpenOutput(const std::string& path, bool split) {
+        if (!timing.Open(Mic::ChunkFile::PathFor(path), rate, channels)) {
+            return false;
+        }
+        if (!split || channels == 1) {
+            return audio.Open(path, rate, channels);
+        }
+        for (int c = 0; c < channels; c++) {
+            channelFiles.emplace_back(new Mic::AudioFile());
+            if (!channelFiles.back()->Open(ChannelPath(path, c), rate, 1)) {
+                std::cout << "ERROR:FILE_OPEN_FAILED " << ChannelPath(path, c) << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string ChannelPath(const std::string& path, int channel) {
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+        std::string extension = (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            ? "" : path.substr(dot);
+        return Mic::SidecarPath(path, ("_ch" + std::to_string(channel + 1) + extension).c_str());
+    }
+
+    // Features of every window of one channel (from 0) to <path without
+    // extension>_features.csv
+    bool OpenFeatures(const std::string& path, int channel, size_t window, size_t hop,
+                      const std::vector<Mic::Band>& bands, double clickFactor) {
+        std::string featurePath = Mic::SidecarPath(path, "_features.csv");
+        featureFile = fopen(featurePath.c_str(), "wb");
+        if (!featureFile) {
+            return false;
+        }
+        features.reset(new Mic::FeatureExtractor(rate, window, hop, bands, clickFactor));
+        featureChannel = channel;
+        features->WriteHeader(featureFile);
+        std::cout << "Acoustic features of channel " << channel + 1 << ": " << window << " sample window (" << window * 1000.0 / rate << " ms), "
+                  << hop << " sample hop, file " << featurePath << std::endl;
+        return true;
+    }
+
+#ifdef MIC_PORTAUDIO
+    // Input device whose name contains pattern on the given host API (-1 = any)
+    static PaDeviceIndex FindDevice(const std::string& pattern, int hostApi) {
+        std::string lowerPattern = Lower(pattern);
+        for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); i++) {
+            const PaDeviceInfo* info = Pa_GetDeviceInfo(i);
+            if (info && info->maxInputChannels > 0 &&
+                Lower(info->name).find(lowerPattern) != std::string::npos &&
+                (hostApi < 0 || info->hostApi == hostApi)) {
+                return i;
+            }
+        }
+        return paNoDevice;
+    }
+
+    // Input devices with the standard rates they accept on all their inputs
+    static void ListDevices() {
+        static const double standardRates[] = { 44100, 48000, 88200, 96000, 176400, 192000, 384000 };
+        for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); i++) {
+            const PaDeviceInfo* info = Pa_GetDeviceInfo(i);
+            if (info && info->maxInputChannels > 0) {
+                const PaHostApiInfo* api = Pa_GetHostApiInfo(info->hostApi);
+                PaStreamParameters input = {};
+                input.device = i;
+                input.channelCount = info->maxInputChannels;
+                input.sampleFormat = paFloat32;
+                input.suggestedLatency = info->defaultLowInputLatency;
+                std::string rates;
+                for (double standard : standardRates) {
+                    if (Pa_IsFormatSupported(&input, nullptr, standard) == paFormatIsSupported) {
+                        rates += (rates.empty() ? "" : "/") + std::to_string((int)standard);
+                    }
+                }
+                printf("DEVICE:%d,api=%d (%s),inputs=%d,rate=%.0f,rates=%s,name=%s\n", i, info->hostApi,
+                       api ? api->name : "?", info->maxInputChannels, info->defaultSampleRate,
+                       rates.empty() ? "?" : rates.c_str(), info->name);
+            }
+        }
+    }
+
+    bool OpenDevice(PaDeviceIndex device) {
+        const PaDeviceInfo* info = Pa_GetDeviceInfo(device);
+        if (channels > info->maxInputChannels) {
+            std::cout << "Device has " << info->maxInputChannels << " inputs, " << channels << " requested" << std::endl;
+            return false;
+        }
+        PaStreamParameters input = {};
+        input.device = device;
+        input.channelCount = channels;
+        input.sampleFormat = paFloat32;
+        input.suggestedLatency = info->defaultLowInputLatency;
+        PaError error = Pa_IsFormatSupported(&input, nullptr, rate);
+        if (error != paFormatIsSupported) {
+            std::cout << "PortAudio: " << Pa_GetErrorText(error) << " (" << channels << " channels at "
+                      << rate << " Hz, see --list)" << std::endl;
+            return false;
+        }
+        error = Pa_OpenStream(&stream, &input, nullptr, rate, chunkFrames, paClipOff,
+                                      &MicRecorder::PortAudioCallback, this);
+        if (error != paNoError) {
+            std::cout << "PortAudio: " << Pa_GetErrorText(error) << std::endl;
+            stream = nullptr;
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    // Run until stopRequested or the time limit, then drain the ring and close the files
+    void Record(double seconds) {
+        startNs = RSI::HostClock::NowNs();
+        running = true;
+        writing = true;
+        featuring = true;
+        std::thread writer(&MicRecorder::WriteLoop, this);
+        if (features) {
+            featureThread = std::thread(&MicRecorder::FeatureLoop, this);
+        }
+
+#ifdef MIC_PORTAUDIO
+        if (stream) {
+            PaError error = Pa_StartStream(stream);
+            if (error != paNoError) {
+                std::cout << "PortAudio: " << Pa_GetErrorText(error) << std::endl;
+                stopRequested = true;
+            }
+        } else
+#endif
+        {
+            synthetic = std::thread(&MicRecorder::SyntheticLoop, this);
+        }
+
+        auto stopAt = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(seconds > 0 ? seconds : 1e9));
+        auto nextReport = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        bool reportedFirst = false;
+        while (!stopRequested && std::chrono::steady_clock::now() < stopAt) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (!reportedFirst && received > 0) {
+                std::cout << "First audio buffer received! Recording started." << std::endl;
+                reportedFirst = true;
+            }
+            if (std::chrono::steady_clock::now() >= nextReport) {
+                std::cout << "Recorded " << received / (double)rate << " s (dropped " << droppedSamples
+                          << " samples, overflows " << overflows << ", ring " << samples.Size() * 100 / samples.Capacity()
+                          << "%, peak " << livePeak.exchange(0.0f) << ", drift " << liveDriftPpm << " ppm";
+                if (features) {
+                    std::cout << ", clicks " << liveClicks.exchange(0);
+                }
+                std::cout << ")" << std::endl;
+                nextReport += std::chrono::seconds(2);
+            }
+        }
+
+#ifdef MIC_PORTAUDIO
+        if (stream) {
+            Pa_StopStream(stream);
+            Pa_CloseStream(stream);
+            stream = nullptr;
+        }
+#endif
+        running = false;
+        if (synthetic.joinable()) {
+            synthetic.join();
+        }
+        writing = false;
+        writer.join();
+        stopNs = RSI::HostClock::NowNs();
+        featuring = false;
+        if (featureThread.joinable()) {
+            featureThread.join();
+        }
+        audio.Close();
+        for (auto& file : channelFiles) {
+            file->Close();
+        }
+        timing.Close();
+        if (featureFile) {
+            fclose(featureFile);
+            featureFile = nullptr;
+        }
+    }
+
+    void PrintSummary() const {
+        printf("OK:RECORD_COMPLETE\n");
+        printf("RATE:%d\n", rate);
+        printf("CHANNELS:%d\n", channels);
+        printf("SAMPLES:%llu\n", (unsigned long long)received.load());
+        printf("WRITTEN:%llu\n", (unsigned long long)written.load());
+        printf("SECONDS:%.3f\n", written.load() / (double)rate);
+        double wallSeconds = (stopNs - startNs) / 1e9;
+        if (wallSeconds > 0) {
+            printf("THROUGHPUT:frames_per_s=%.0f,mb_per_s=%.1f,realtime=%.2f\n", written.load() / wallSeconds,
+                   written.load() * channels * sizeof(float) / wallSeconds / 1e6,
+                   written.load() / (double)rate / wallSeconds);
+        }
+        printf("DROPPED:samples=%llu,chunks=%llu\n", (unsigned long long)droppedSamples.load(),
+               (unsigned long long)droppedChunks.load());
+        printf("OVERFLOWS:%llu\n", (unsigned long long)overflows.load());
+        uint64_t clipped = audio.Clipped();
+        for (const auto& file : channelFiles) {
+            clipped += file->Clipped();
+        }
+        printf("CLIPPED:%llu\n", (unsigned long long)clipped);
+        printf("ADC_TIMES:%llu\n", (unsigned long long)adcStamped.load());
+        printf("CLOCK:drift_ppm=%.3f,fits=%llu,outliers=%llu,resets=%llu\n", clock.DriftPpm(),
+               (unsigned long long)clock.fits, (unsigned long long)clock.outliers,
+               (unsigned long long)clock.resets);
+        if (clock.residual.Count() > 0) {
+            printf("CLOCK_RESIDUAL_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   clock.residual.PercentileUs(0.50), clock.residual.PercentileUs(0.99),
+                   clock.residual.MaxUs(), clock.residual.MeanUs());
+        }
+        if (callbackTime.Count() > 0) {
+            printf("CALLBACK_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   callbackTime.PercentileUs(0.50), callbackTime.PercentileUs(0.99),
+                   callbackTime.MaxUs(), callbackTime.MeanUs());
+        }
+        if (callbackGap.Count() > 0) {
+            printf("CALLBACK_GAP_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   callbackGap.PercentileUs(0.50), callbackGap.PercentileUs(0.99),
+                   callbackGap.MaxUs(), callbackGap.MeanUs());
+        }
+        if (features) {
+            printf("FEATURES:windows=%llu,gaps=%llu,dropped=%llu,clicks=%llu\n",
+                   (unsigned long long)featureWindows.load(), (unsigned long long)featureGaps,
+                   (unsigned long long)featureDropped.load(), (unsigned long long)features->TotalClicks());
+        }
+        if (syntheticClicks > 0) {
+            printf("SYNTHETIC_CLICKS:%llu\n", (unsigned long long)syntheticClicks);
+        }
+        printf("ERRORS:write=%llu\n", (unsigned long long)writeErrors);
+        fflush(stdout);
+    }
+
+private:
+    // About a second of buffers per floor point, two minutes of them per fit
+    static const int ClockBlockBuffers = 50;
+    static const size_t ClockWindowBlocks = 120;
+    static const size_t FeatureRingBlocks = 256;  // About 5 s at 48 kHz
+    static const size_t SyntheticNoiseSamples = 1 << 16;
+
+    // Chunk records for a ring of samples, with room for buffers of 16 frames
+    static size_t RecordCapacity(size_t ringSamples, int channelCount) {
+        size_t capacity = ringSamples / 16;
+        while (capacity > 1024 && (capacity >> 1) * 16 * (size_t)channelCount >= ringSamples) {
+            capacity >>= 1;
+        }
+        return capacity;
+    }
+
+    static std::string Lower(std::string text) {
+        for (char& c : text) {
+            c = (char)tolower((unsigned char)c);
+        }
+        return text;
+    }
+
+#ifdef MIC_PORTAUDIO
+    static int PortAudioCallback(const void* input, void*, unsigned long frames,
+                                 const PaStreamCallbackTimeInfo* time, PaStreamCallbackFlags flags, void* user) {
+        MicRecorder* recorder = static_cast<MicRecorder*>(user);
+        recorder->OnBuffer(static_cast<const float*>(input), frames, time->inputBufferAdcTime,
+                           time->currentTime, (flags & paInputOverflow) ? 1u : 0u);
+        return paContinue;
+    }
+#endif
+
+    // Audio thread: copy one buffer of interleaved frames into the ring, or
+    // count it as dropped.  A buffer is kept or dropped whole so chunk
+    // records stay exact.
+    // adcTime and streamTime are on the stream's clock; drivers that do not
+    // provide them give 0.
+    void OnBuffer(const float* data, size_t frames, double adcTime, double streamTime, uint32_t status) {
+        int64_t now = RSI::HostClock::NowNs();
+        bool adcValid = streamTime > 0 && adcTime <= streamTime && streamTime - adcTime < 1.0;
+        int64_t captureNs = adcValid ? now - (int64_t)((streamTime - adcTime) * 1e9)
+                                     : now - (int64_t)(frames * 1e9 / rate);
+        if (adcValid) {
+            adcStamped++;
+        }
+        if (lastCallbackNs != 0) {
+            callbackGap.Add(now - lastCallbackNs);
+        }
+        lastCallbackNs = now;
+        if (status) {
+            overflows++;
+        }
+
+        size_t recordFree = 0;
+        ChunkRecord* record = chunks.Reserve(&recordFree);
+        size_t free = samples.Capacity() - samples.Size();
+        size_t total = frames * channels;
+        if (!data || recordFree == 0 || free < total) {
+            droppedSamples += frames;
+            droppedChunks++;
+            received += frames;
+            return;
+        }
+
+        float peak = 0.0f;
+        size_t copied = 0;
+        while (copied < total) {
+            size_t contiguous = 0;
+            float* target = samples.Reserve(&contiguous);
+            size_t count = total - copied < contiguous ? total - copied : contiguous;
+            for (size_t i = 0; i < count; i++) {
+                float value = data[copied + i];
+                target[i] = value;
+                float magnitude = value < 0 ? -value : value;
+                if (magnitude > peak) {
+                    peak = magnitude;
+                }
+            }
+            samples.Commit(count);
+            copied += count;
+        }
+
+        record->sampleIndex = queued;
+        record->deviceIndex = received;
+        record->frames = (uint32_t)frames;
+        record->status = status;
+        record->hostNs = now;
+        record->captureNs = captureNs;
+        record->adcTime = adcTime;
+        chunks.Commit(1);
+        queued += frames;
+        received += frames;
+        if (peak > livePeak.load(std::memory_order_relaxed)) {
+            livePeak.store(peak, std::memory_order_relaxed);
+        }
+        callbackTime.Add(RSI::HostClock::NowNs() - now);
+    }
+
+    // Stand-in for the microphone: on each channel a tone (180 Hz, and a
+    // harmonic higher on every further channel) with noise and, at random
+    // about 60 times a second, the sharp decaying pulse of a short circuit,
+    // weaker on the further channels.  Buffers of chunk frames come at the
+    // sample rate, or clockPpm off it, times speed; with a speed of 0 as
+    // fast as the ring has room.  Like a driver it reports each buffer's
+    // ADC time on a stream clock (seconds since the start), exact where the
+    // delivery is late by however long the thread took to wake.  The tones
+    // turn as phasors and the noise comes from a table, so a sample costs a
+    // few multiplies even at 192 kHz on many channels.
+    void SyntheticLoop() {
+        using Clock = std::chrono::steady_clock;
+        std::vector<float> buffer((size_t)chunkFrames * channels);
+        std::mt19937 random(1);
+        std::normal_distribution<float> normal(0.0f, 0.02f);
+        std::vector<float> noise(SyntheticNoiseSamples);
+        for (float& value : noise) {
+            value = normal(random);
+        }
+        std::exponential_distribution<double> clickGap(60.0);
+        double nextClick = clickGap(random);
+        double pulse = 0.0;
+        double pulseDecay = exp(-4000.0 / rate);
+        const double twoPi = 6.283185307179586;
+        std::vector<double> toneRe(channels, 1.0), toneIm(channels, 0.0);
+        std::vector<double> stepRe(channels), stepIm(channels);
+        for (int c = 0; c < channels; c++) {
+            stepRe[c] = cos(twoPi * 180.0 * (c + 1) / rate);
+            stepIm[c] = sin(twoPi * 180.0 * (c + 1) / rate);
+        }
+        size_t noiseIndex = 0;
+        uint64_t sample = 0;
+
+        RSI::PinCurrentThread(-1);
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        double pace = rate * (1.0 + clockPpm * 1e-6) * speed;
+        auto start = Clock::now();
+        while (running) {
+            sample += chunkFrames;
+            if (pace > 0) {
+                auto due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(sample / pace));
+                std::this_thread::sleep_until(due);
+            } else {
+                while (running && samples.Capacity() - samples.Size() < buffer.size()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                if (!running) {
+                    break;
+                }
+            }
+            float* frame = buffer.data();
+            for (int i = 0; i < chunkFrames; i++, frame += channels) {
+                double t = (double)(sample - chunkFrames + i) / rate;
+                if (t >= nextClick) {
+                    pulse = 0.6;
+                    syntheticClicks++;
+                    nextClick = t + 0.002 + clickGap(random);
+                }
+                for (int c = 0; c < channels; c++) {
+                    frame[c] = (float)(0.3 * toneIm[c] + pulse / (c + 1)) + noise[noiseIndex++ & (SyntheticNoiseSamples - 1)];
+                    double re = toneRe[c] * stepRe[c] - toneIm[c] * stepIm[c];
+                    toneIm[c] = toneRe[c] * stepIm[c] + toneIm[c] * stepRe[c];
+                    toneRe[c] = re;
+                }
+                pulse *= pulseDecay;
+            }
+            // Keep the phasors on the unit circle
+            for (int c = 0; c < channels; c++) {
+                double magnitude = sqrt(toneRe[c] * toneRe[c] + toneIm[c] * toneIm[c]);
+                toneRe[c] /= magnitude;
+                toneIm[c] /= magnitude;
+            }
+            if (pace > 0) {
+                double streamTime = std::chrono::duration<double>(Clock::now() - start).count();
+                OnBuffer(buffer.data(), chunkFrames, (sample - chunkFrames) / pace, streamTime, 0);
+            } else {
+                OnBuffer(buffer.data(), chunkFrames, 0.0, 0.0, 0);
+            }
+        }
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    // Writer thread: stream samples and chunk records to disk
+    void WriteLoop() {
+        auto lastFlush = std::chrono::steady_clock::now();
+        while (true) {
+            bool draining = !writing;
+            size_t count = 0;
+            float* block = samples.Peek(&count);
+            size_t whole = count - count % channels;
+            if (whole > 0) {
+                WriteFrames(block, whole / channels);
+                samples.Release(whole);
+            } else if (count > 0 && samples.Size() >= (size_t)channels) {
+                // A frame split by the end of the ring
+                float frame[MaxChannels];
+                memcpy(frame, block, count * sizeof(float));
+                samples.Release(count);
+                size_t rest = 0;
+                const float* wrapped = samples.Peek(&rest);
+                memcpy(frame + count, wrapped, (channels - count) * sizeof(float));
+                samples.Release(channels - count);
+                WriteFrames(frame, 1);
+                whole = channels;
+            }
+
+            size_t records = 0;
+            ChunkRecord* batch = chunks.Peek(&records);
+            for (size_t i = 0; i < records; i++) {
+                WriteRecord(batch[i]);
+            }
+            chunks.Release(records);
+
+            if (whole == 0 && records == 0) {
+                if (draining && samples.Size() == 0 && chunks.Size() == 0) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+
+            // Flush often enough that a crash loses little
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastFlush >= std::chrono::milliseconds(250)) {
+                audio.Flush();
+                for (auto& file : channelFiles) {
+                    file->Flush();
+                }
+                timing.Flush();
+                liveDriftPpm = clock.DriftPpm();
+                lastFlush = now;
+            }
+        }
+    }
+
+    // Writer thread: frames to the audio file or one file per channel, and
+    // the feature channel on to the feature thread
+    void WriteFrames(const float* block, size_t frames) {
+        if (channelFiles.empty()) {
+            if (!audio.Write(block, frames * channels)) {
+                writeErrors++;
+            }
+        } else {
+            channelScratch.resize(frames);
+            for (int c = 0; c < channels; c++) {
+                for (size_t i = 0; i < frames; i++) {
+                    channelScratch[i] = block[i * channels + c];
+                }
+                if (!channelFiles[c]->Write(channelScratch.data(), frames)) {
+                    writeErrors++;
+                }
+            }
+        }
+        if (features) {
+            if (channels == 1) {
+                ForwardToFeatures(block, frames, written);
+            } else {
+                featureScratch.resize(frames);
+                for (size_t i = 0; i < frames; i++) {
+                    featureScratch[i] = block[i * channels + featureChannel];
+                }
+                ForwardToFeatures(featureScratch.data(), frames, written);
+            }
+        }
+        written += frames;
+    }
+
+    // Writer thread: copy samples into feature blocks, dropping what does not fit
+    void ForwardToFeatures(const float* block, size_t count, uint64_t firstSample) {
+        while (count > 0) {
+            size_t free = 0;
+            FeatureBlock* target = featureRing.Reserve(&free);
+            size_t take = count < sizeof(target->samples) / sizeof(float) ? count : sizeof(target->samples) / sizeof(float);
+            if (free == 0) {
+                featureDropped += count;
+                return;
+            }
+            target->firstSample = firstSample;
+            target->count = (uint32_t)take;
+            memcpy(target->samples, block, take * sizeof(float));
+            featureRing.Commit(1);
+            block += take;
+            firstSample += take;
+            count -= take;
+        }
+    }
+
+    // Feature thread: gather samples into windows and write one row per hop
+    void FeatureLoop() {
+        std::vector<float> pending;
+        pending.reserve(features->Window() + sizeof(FeatureBlock::samples) / sizeof(float));
+        uint64_t pendingStart = 0;
+        Mic::FeatureRow row;
+
+        while (true) {
+            bool draining = !featuring;
+            size_t count = 0;
+            FeatureBlock* blocks = featureRing.Peek(&count);
+            if (count == 0) {
+                if (draining) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            for (size_t b = 0; b < count; b++) {
+                const FeatureBlock& block = blocks[b];
+                if (block.firstSample != pendingStart + pending.size()) {
+                    // Samples were dropped on the way; windows start over after the gap
+                    if (pendingStart != 0 || !pending.empty()) {
+                        featureGaps++;
+                    }
+                    pending.clear();
+                    pendingStart = block.firstSample;
+                    features->Restart();
+                }
+                pending.insert(pending.end(), block.samples, block.samples + block.count);
+                while (pending.size() >= features->Window()) {
+                    features->Process(pending.data(), pendingStart, row);
+                    if (!features->WriteRow(featureFile, row)) {
+                        writeErrors++;
+                    }
+                    featureWindows++;
+                    liveClicks += row.clicks;
+                    pending.erase(pending.begin(), pending.begin() + features->Hop());
+                    pendingStart += features->Hop();
+                }
+            }
+            featureRing.Release(count);
+            fflush(featureFile);
+        }
+    }
+
+    void WriteRecord(const ChunkRecord& record) {
+        int64_t correctedNs = clock.Add((int64_t)record.deviceIndex, record.captureNs);
+        Mic::ChunkTiming entry;
+        entry.sampleIndex = (int64_t)record.sampleIndex;
+        entry.deviceIndex = (int64_t)record.deviceIndex;
+        entry.frames = record.frames;
+        entry.status = record.status;
+        entry.unixTimeNs = RSI::HostClock::ToUnixNs(record.hostNs);
+        entry.adcTime = record.adcTime;
+        entry.correctedUnixNs = RSI::HostClock::ToUnixNs(correctedNs);
+        if (!timing.Write(entry)) {
+            writeErrors++;
+        }
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+#ifdef MIC_PORTAUDIO
+              << "  --list                     List input devices\n"
+#endif
+              << "  --record <file> [options]  Record to file until Ctrl+C or 'q': .wav is float32 WAV,\n"
+              << "                             .flac is 24-bit FLAC, anything else raw float32\n"
+              << "  Options:\n"
+#ifdef MIC_PORTAUDIO
+              << "    --device <name>          Part of the input device name (default " << DefaultDevice << ")\n"
+              << "    --api <n>                PortAudio host API index, -1 = any (default " << DefaultHostApi << ")\n"
+#endif
+              << "    --simulate               Synthetic tone instead of a device\n"
+              << "    --clock-ppm <ppm>        Run the synthetic source's sample clock fast (default 0)\n"
+              << "    --speed <x>              Run the synthetic source x times real time, 0 = flat out (default 1)\n"
+              << "    --rate <hz>              Sample rate, up to what the device takes (default " << DefaultRate << ")\n"
+              << "    --channels <n>           Input channels, interleaved in the file (default 1)\n"
+              << "    --split-channels         One mono file per channel, <name>_ch1.<ext> and so on\n"
+              << "    --chunk <frames>         Frames per buffer (default " << DefaultChunk << ")\n"
+              << "    --ring <seconds>         Audio buffered ahead of the writer (default 10)\n"
+              << "    --seconds <s>            Stop after this long (default until stopped)\n"
+              << "    --features               Write acoustic features per window to <name>_features.csv\n"
+              << "    --feature-channel <n>    Channel the features are computed on (default 1)\n"
+              << "    --feature-window <n>     Samples per FFT window, power of two (default 2048)\n"
+              << "    --feature-hop <ms>       Time between windows (default 10)\n"
+              << "    --bands <list>           Bands for the band powers in Hz (default " << Mic::DefaultBands << ")\n"
+              << "    --click-factor <x>       Step over x times the typical step counts as a click (default 8)\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    std::string outputPath;
+    std::string device = DefaultDevice;
+    int hostApi = DefaultHostApi;
+    bool simulate = false;
+    int rate = DefaultRate;
+    int chunk = DefaultChunk;
+    double ringSeconds = 10.0;
+    double seconds = 0.0;
+    double clockPpm = 0.0;
+    double speed = 1.0;
+    int channels = 1;
+    bool splitChannels = false;
+    bool featuresWanted = false;
+    int featureChannel = 1;
+    size_t featureWindow = 2048;
+    double featureHopMs = 10.0;
+    std::string bandList = Mic::DefaultBands;
+    double clickFactor = 8.0;
+    int first = 2;
+
+#ifdef MIC_PORTAUDIO
+    if (command == "--list") {
+        Pa_Initialize();
+        MicRecorder::ListDevices();
+        Pa_Terminate();
+        return 0;
+    }
+#endif
+    if (command == "--record" && argc >= 3) {
+        outputPath = argv[2];
+        first = 3;
+    } else {
+        PrintUsage();
+        return 1;
+    }
+
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--device" && i + 1 < argc) device = argv[++i];
+        else if (arg == "--api" && i + 1 < argc) hostApi = atoi(argv[++i]);
+        else if (arg == "--simulate") simulate = true;
+        else if (arg == "--clock-ppm" && i + 1 < argc) clockPpm = atof(argv[++i]);
+        else if (arg == "--speed" && i + 1 < argc) speed = atof(argv[++i]);
+        else if (arg == "--channels" && i + 1 < argc) channels = atoi(argv[++i]);
+        else if (arg == "--split-channels") splitChannels = true;
+        else if (arg == "--features") featuresWanted = true;
+        else if (arg == "--feature-channel" && i + 1 < argc) featureChannel = atoi(argv[++i]);
+        else if (arg == "--feature-window" && i + 1 < argc) featureWindow = (size_t)atol(argv[++i]);
+        else if (arg == "--feature-hop" && i + 1 < argc) featureHopMs = atof(argv[++i]);
+        else if (arg == "--bands" && i + 1 < argc) bandList = argv[++i];
+        else if (arg == "--click-factor" && i + 1 < argc) clickFactor = atof(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc) rate = atoi(argv[++i]);
+        else if (arg == "--chunk" && i + 1 < argc) chunk = atoi(argv[++i]);
+        else if (arg == "--ring" && i + 1 < argc) ringSeconds = atof(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) seconds = atof(argv[++i]);
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (rate <= 0 || chunk <= 0 || ringSeconds <= 0 || speed < 0) {
+        PrintUsage();
+        return 1;
+    }
+    if (channels < 1 || channels > MaxChannels) {
+        std::cout << "ERROR:BAD_CHANNELS 1 to " << MaxChannels << " channels" << std::endl;
+        return 1;
+    }
+    std::vector<Mic::Band> bands;
+    size_t featureHop = (size_t)(featureHopMs * rate / 1000.0);
+    if (featuresWanted && (featureWindow < 64 || featureWindow > 65536 || (featureWindow & (featureWindow - 1)) ||
+                           featureHop < 1 || featureHop > featureWindow || clickFactor <= 0 ||
+                           featureChannel < 1 || featureChannel > channels ||
+                           !Mic::ParseBands(bandList, bands))) {
+        std::cout << "ERROR:BAD_FEATURE_OPTIONS window must be a power of two from 64 to 65536 "
+                  << "and the hop no longer than it, on one of the recorded channels" << std::endl;
+        return 1;
+    }
+
+    if (Mic::AudioFile::FormatOf(outputPath) == Mic::AudioFile::Format::Flac && !Mic::AudioFile::FlacAvailable()) {
+        std::cout << "ERROR:NO_FLAC built without libFLAC, use .wav" << std::endl;
+        return 1;
+    }
+    if (Mic::AudioFile::FormatOf(outputPath) == Mic::AudioFile::Format::Flac && channels > 8 && !splitChannels) {
+        std::cout << "ERROR:FLAC_CHANNELS FLAC holds up to 8 channels, use --split-channels or .wav" << std::endl;
+        return 1;
+    }
+
+    // The rings index with a mask
+    size_t capacity = 1024;
+    while (capacity < (size_t)(ringSeconds * rate * channels) || capacity < (size_t)chunk * channels * 16) {
+        capacity <<= 1;
+    }
+    MicRecorder recorder(capacity, rate, chunk, channels);
+    recorder.SetClockPpm(clockPpm);
+    recorder.SetSpeed(speed);
+
+#ifdef MIC_PORTAUDIO
+    bool portAudio = !simulate;
+    if (portAudio) {
+        PaError error = Pa_Initialize();
+        if (error != paNoError) {
+            std::cout << "ERROR:PORTAUDIO_INIT_FAILED " << Pa_GetErrorText(error) << std::endl;
+            return 1;
+        }
+        PaDeviceIndex index = MicRecorder::FindDevice(device, hostApi);
+        if (index == paNoDevice) {
+            std::cout << "ERROR:DEVICE_NOT_FOUND " << device << std::endl;
+            Pa_Terminate();
+            return 1;
+        }
+        if (!recorder.OpenDevice(index)) {
+            std::cout << "ERROR:STREAM_OPEN_FAILED " << device << std::endl;
+            Pa_Terminate();
+            return 1;
+        }
+        std::cout << "Recording " << Pa_GetDeviceInfo(index)->name << ", " << channels << " channel(s) at "
+                  << rate << " Hz" << std::endl;
+    }
+#else
+    (void)device;
+    (void)hostApi;
+    if (!simulate) {
+        std::cout << "ERROR:NO_AUDIO_BACKEND built without PortAudio, use --simulate" << std::endl;
+        return 1;
+    }
+#endif
+    if (simulate) {
+        std::cout << "Recording the synthetic source, " << channels << " channel(s) at " << rate << " Hz" << std::endl;
+    }
+
+    if (!recorder.OpenOutput(outputPath, splitChannels)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << outputPath << std::endl;
+        return 1;
+    }
+    if (featuresWanted && !recorder.OpenFeatures(outputPath, featureChannel - 1, featureWindow, featureHop, bands, clickFactor)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << Mic::SidecarPath(outputPath, "_features.csv") << std::endl;
+        return 1;
+    }
+
+    // Ctrl+C, or 'q' from Microphone.py; end of input only ends an untimed run
+    std::signal(SIGINT, HandleStopSignal);
+    std::signal(SIGTERM, HandleStopSignal);
+    std::thread([seconds]() {
+        std::string input;
+        while (std::getline(std::cin, input)) {
+            if (input == "q" || input == "Q") {
+                stopRequested = true;
+                return;
+            }
+        }
+        // Input closed: the parent script is gone, unless stdin was never
+        // connected (a scheduler or service), which --seconds covers
+        if (seconds <= 0) {
+            stopRequested = true;
+        }
+    }).detach();
+
+    std::cout << "OK:RECORDING_STARTED" << std::endl;
+    recorder.Record(seconds);
+    recorder.PrintSummary();
+#ifdef MIC_PORTAUDIO
+    if (portAudio) {
+        Pa_Terminate();
+    }
+#endif
+    return 0;
+}
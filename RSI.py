@@ -5,7 +5,8 @@ import platform
 import subprocess
 from datetime import datetime
 import os
-from threading import Event
+import queue
+from threading import Event, Thread
 from typing import List, Tuple
 
 # Global flag for graceful shutdown
@@ -38,9 +39,398 @@ def verify_connection(ip="192.168.1.25", port=59152):
     except Exception as e:
         return False, f"Connection error: {str(e)}"
 
-def collect_raw_data(ip="192.168.1.25", port=59152, stop_flag=None) -> List[Tuple[str, float, float]]:
-    """Collect raw XML data with absolute and relative timestamps until stopped"""
+def raw_data_filename(filename: str = None) -> str:
+    """Default, .txt extension and absolute path for a raw data file"""
+    if not filename:
+        timestamp_str = datetime.now().strftime('%Y%m%d_%H%M%S')
+        filename = f"robot_raw_{timestamp_str}.txt"
+    
+    if not filename.endswith('.txt'):
+        filename += '.txt'
+    
+    if not os.path.isabs(filename):
+        filename = os.path.join(os.getcwd(), filename)
+    return filename
+
+def format_raw_line(xml_str: str, abs_time: float, rel_time: float) -> str:
+    """One SystemTime|RelativeTime|XML line"""
+    system_time = datetime.fromtimestamp(abs_time).strftime('%Y-%m-%d %H:%M:%S.%f')
+    safe_xml = xml_str.replace('|', '&#124;')
+    return f"{system_time}|{rel_time:.6f}|{safe_xml}\n"
+
+class RawDataWriter:
+    """Streams packets to a raw data file while collecting.  Packets are
+    grouped into blocks that a background thread writes and flushes, so a
+    crash loses at most the last block.  At most max_blocks blocks wait for
+    the writer; if the disk falls that far behind, new blocks are dropped and
+    counted rather than growing memory."""
+
+    def __init__(self, filename: str, block_packets: int = 250, block_seconds: float = 0.5,
+                 max_blocks: int = 64):
+        self.filename = filename
+        self.block_packets = block_packets
+        self.block_seconds = block_seconds
+        self.blocks = queue.Queue(maxsize=max_blocks)
+        self.block = []
+        self.block_started = time.perf_counter()
+        self.written = 0
+        self.dropped = 0
+        self.error = None
+        self.file = open(filename, 'w', encoding='utf-8')
+        self.file.write("# SystemTime|RelativeTime|XML\n")
+        self.file.flush()
+        self.thread = Thread(target=self._write_loop, daemon=True)
+        self.thread.start()
+
+    def add(self, xml_str: str, abs_time: float, rel_time: float):
+        if not self.block:
+            self.block_started = time.perf_counter()
+        self.block.append((xml_str, abs_time, rel_time))
+        if (len(self.block) >= self.block_packets or
+                time.perf_counter() - self.block_started >= self.block_seconds):
+            self.submit()
+
+    def submit(self):
+        """Hand the current block to the writer thread"""
+        if not self.block:
+            return
+        try:
+            self.blocks.put_nowait(self.block)
+        except queue.Full:
+            self.dropped += len(self.block)
+        self.block = []
+
+    def close(self):
+        """Write what is left and close the file"""
+        self.submit()
+        self.blocks.put(None)
+        self.thread.join()
+        self.file.close()
+
+    def _write_loop(self):
+        while True:
+            block = self.blocks.get()
+            if block is None:
+                break
+            if self.error:
+                continue
+            try:
+                self.file.write(''.join(format_raw_line(*packet) for packet in block))
+                self.file.flush()
+                self.written += len(block)
+            except Exception as e:
+                self.error = e
+                print(f"Error writing data: {e}")
+
+class TimeHistogram:
+    """Counts of durations in 50 us bins up to 50 ms, plus an overflow bin"""
+
+    def __init__(self, bin_us=50, bins=1000):
+        self.bin_us = bin_us
+        self.counts = [0] * (bins + 1)
+        self.total = 0
+        self.max_us = 0.0
+        self.sum_us = 0.0
+
+    def add(self, seconds):
+        us = max(seconds * 1e6, 0.0)
+        self.counts[min(int(us // self.bin_us), len(self.counts) - 1)] += 1
+        self.total += 1
+        self.max_us = max(self.max_us, us)
+        self.sum_us += us
+
+    def percentile(self, fraction):
+        """Upper edge of the bin holding the fraction, clamped to the maximum"""
+        target = int(fraction * self.total)
+        seen = 0
+        for i, count in enumerate(self.counts):
+            seen += count
+            if seen > target:
+                return min((i + 1) * self.bin_us, self.max_us)
+        return self.max_us
+
+    def summary(self):
+        mean = self.sum_us / self.total if self.total else 0.0
+        return (f"p50={self.percentile(0.5):.0f},p99={self.percentile(0.99):.0f},"
+                f"max={self.max_us:.0f},mean={mean:.1f}")
+
+class IpocMonitor:
+    """Follows the robot's IPOC counter (milliseconds, one step per IPO cycle)
+    to count lost, repeated and reordered packets, and times arrivals against
+    their cycle.  Same checks as the native receiver: jitter is the arrival
+    interval's distance from the cycles it spans, lateness is how far a
+    packet is behind the earliest arrival slot of the last few seconds.
+    Without period_ms the period is the smallest step of the first packets."""
+
+    LEARN_PACKETS = 16
+    WINDOW = 1024
+
+    def __init__(self, period_ms=None):
+        self.period = period_ms
+        self.pending = []
+        self.packets = 0
+        self.missing = 0
+        self.gaps = 0
+        self.max_gap = 0
+        self.duplicates = 0
+        self.reordered = 0
+        self.late = 0
+        self.no_ipoc = 0
+        self.jitter = TimeHistogram()
+        self.lateness = TimeHistogram()
+        self.first_ipoc = None
+        self.highest = 0
+        self.highest_time = 0.0
+        self.seen = [False] * self.WINDOW
+        self.block_min = float('inf')
+        self.previous_block_min = float('inf')
+        self.block_count = 0
+
+    def add_packet(self, xml_str, arrival):
+        """Track one packet by the IPOC in its XML; arrival in seconds"""
+        start = xml_str.find('<IPOC>')
+        end = xml_str.find('</IPOC>', start)
+        try:
+            ipoc = int(xml_str[start + 6:end])
+        except ValueError:
+            ipoc = None
+        if start < 0 or ipoc is None:
+            self.no_ipoc += 1
+            return
+        self.add(ipoc, arrival)
+
+    def add(self, ipoc, arrival):
+        self.packets += 1
+        if not self.period:
+            self.pending.append((ipoc, arrival))
+            if len(self.pending) >= self.LEARN_PACKETS:
+                self._learn()
+            return
+        self._track(ipoc, arrival)
+
+    def finish(self):
+        """Count packets still held back while learning the period"""
+        if not self.period and self.pending:
+            self._learn()
+
+    def status(self):
+        return (f"missing {self.missing}, duplicate {self.duplicates}, reordered {self.reordered}, "
+                f"late {self.late}, jitter p99 {self.jitter.percentile(0.99):.0f} us")
+
+    def summary(self):
+        lines = [f"IPOC: period={self.period}, missing={self.missing}, gaps={self.gaps}, "
+                 f"max_gap={self.max_gap}, duplicate={self.duplicates}, reordered={self.reordered}, "
+                 f"late={self.late}, no_ipoc={self.no_ipoc}"]
+        if self.jitter.total:
+            lines.append(f"Jitter (us): {self.jitter.summary()}")
+        if self.lateness.total:
+            lines.append(f"Lateness (us): {self.lateness.summary()}")
+        return "\n".join(lines)
+
+    def _learn(self):
+        steps = [b[0] - a[0] for a, b in zip(self.pending, self.pending[1:]) if b[0] > a[0]]
+        self.period = min(steps) if steps else 4
+        pending, self.pending = self.pending, []
+        for ipoc, arrival in pending:
+            self._track(ipoc, arrival)
+
+    def _track(self, ipoc, arrival):
+        if self.first_ipoc is None:
+            self.first_ipoc = ipoc
+            self.highest_time = arrival
+            self.seen[0] = True
+            self._lateness(0, arrival)
+            return
+
+        cycle = (ipoc - self.first_ipoc) // self.period
+        if cycle > self.highest:
+            skipped = cycle - self.highest - 1
+            if skipped > 0:
+                self.missing += skipped
+                self.gaps += 1
+                self.max_gap = max(self.max_gap, skipped)
+            for c in range(self.highest + 1, min(cycle, self.highest + self.WINDOW + 1)):
+                self.seen[c % self.WINDOW] = False
+            self.seen[cycle % self.WINDOW] = True
+            expected = (cycle - self.highest) * self.period / 1000.0
+            self.jitter.add(abs(arrival - self.highest_time - expected))
+            self.highest = cycle
+            self.highest_time = arrival
+        elif 0 <= cycle and self.highest - cycle < self.WINDOW:
+            if self.seen[cycle % self.WINDOW]:
+                self.duplicates += 1
+                return
+            self.seen[cycle % self.WINDOW] = True
+            self.reordered += 1
+            self.missing = max(self.missing - 1, 0)
+        else:
+            # Too old to tell a repeat from a late arrival
+            self.reordered += 1
+            return
+        self._lateness(cycle, arrival)
+
+    def _lateness(self, cycle, arrival):
+        offset = arrival - cycle * self.period / 1000.0
+        self.block_min = min(self.block_min, offset)
+        behind = offset - min(self.block_min, self.previous_block_min)
+        self.lateness.add(behind)
+        if behind > self.period / 1000.0:
+            self.late += 1
+        self.block_count += 1
+        if self.block_count == self.WINDOW:
+            self.previous_block_min = self.block_min
+            self.block_min = float('inf')
+            self.block_count = 0
+
+class IpocClockFit:
+    """Maps the robot's IPOC (controller milliseconds) onto host time, as
+    ClockFit in the native receiver does.  Delays only ever make a packet
+    late, so each block of packets contributes its least-delayed packet and
+    a line is fitted through those floor points over the last minute or so.
+    Floor points far above the line are left out; several in a row restart
+    the fit.  The corrected time is the line at the packet's IPOC."""
+
+    RESET_GAP_MS = 60000
+    REJECT_LIMIT = 5
+    MIN_REJECT = 200e-6
+
+    def __init__(self, block_packets=250, window_blocks=60):
+        self.block_packets = block_packets
+        self.window_blocks = window_blocks
+        self.fits = 0
+        self.outliers = 0
+        self.resets = 0
+        self.started = False
+        self.last_ipoc = 0
+
+    def add(self, ipoc, host_time):
+        """Corrected host time (seconds) for a packet received at host_time"""
+        if (not self.started or ipoc + self.RESET_GAP_MS < self.last_ipoc or
+                ipoc - self.last_ipoc > self.RESET_GAP_MS):
+            if self.started:
+                self.resets += 1
+            self._reset(ipoc, host_time)
+        self.last_ipoc = max(self.last_ipoc, ipoc)
+
+        x = (ipoc - self.ipoc0) / 1000.0
+        y = host_time - self.host0
+        if y - x < self.block_floor:
+            self.block_floor, self.block_point = y - x, (x, y)
+        self.floor_offset = min(self.floor_offset, y - x)
+        self.block_count += 1
+        if self.block_count == self.block_packets:
+            self._add_point(*self.block_point)
+            self.block_count = 0
+            self.block_floor = float('inf')
+
+        if len(self.points) >= 2:
+            corrected = self.intercept + self.slope * x
+        else:
+            corrected = self.floor_offset + x
+        return self.host0 + corrected
+
+    def drift_ppm(self):
+        """Positive when the controller's clock runs fast against the host's"""
+        return (1.0 / self.slope - 1.0) * 1e6 if len(self.points) >= 2 else 0.0
+
+    def _reset(self, ipoc, host_time):
+        self.started = True
+        self.ipoc0 = ipoc
+        self.host0 = host_time
+        self.last_ipoc = ipoc
+        self.block_count = 0
+        self.block_floor = float('inf')
+        self.block_point = None
+        self.floor_offset = float('inf')
+        self.points = []
+        self.slope = 1.0
+        self.intercept = 0.0
+        self.rejected = 0
+
+    def _add_point(self, x, y):
+        if len(self.points) >= 3:
+            spread = sorted(abs(py - (self.intercept + self.slope * px)) for px, py in self.points)
+            limit = max(3.0 * spread[len(spread) // 2], self.MIN_REJECT)
+            if y - (self.intercept + self.slope * x) > limit:
+                self.outliers += 1
+                self.rejected += 1
+                if self.rejected < self.REJECT_LIMIT:
+                    return
+                self.resets += 1
+                self.points = []
+        self.rejected = 0
+        self.points.append((x, y))
+        if len(self.points) > self.window_blocks:
+            self.points.pop(0)
+        if len(self.points) >= 2:
+            mean_x = sum(px for px, _ in self.points) / len(self.points)
+            mean_y = sum(py for _, py in self.points) / len(self.points)
+            sxx = sum((px - mean_x) ** 2 for px, _ in self.points)
+            sxy = sum((px - mean_x) * (py - mean_y) for px, py in self.points)
+            if sxx > 0:
+                self.slope = sxy / sxx
+                self.intercept = mean_y - self.slope * mean_x
+                self.fits += 1
+
+def align_robot_timestamps(raw_file, output_file=None):
+    """Fit the IPOC clock over a save_raw_data recording and write a CSV of
+    SystemTime,RelativeTime,IPOC,CorrectedTime,CorrectedRelativeTime, the
+    corrected times being the IPOC mapped onto the host clock.  Returns the
+    output file name, or None."""
+    if not output_file:
+        output_file = os.path.splitext(raw_file)[0] + "_aligned.csv"
+    fit = IpocClockFit()
+    residuals = []
+    try:
+        with open(raw_file, 'r', encoding='utf-8') as f, open(output_file, 'w', encoding='utf-8') as out:
+            out.write("SystemTime,RelativeTime,IPOC,CorrectedTime,CorrectedRelativeTime\n")
+            for line in f:
+                if line.startswith('#'):
+                    continue
+                parts = line.rstrip('\n').split('|', 2)
+                if len(parts) < 3:
+                    continue
+                system_time, relative, xml_str = parts
+                relative = float(relative)
+                start = xml_str.find('<IPOC>')
+                end = xml_str.find('</IPOC>', start)
+                try:
+                    ipoc = int(xml_str[start + 6:end]) if start >= 0 else None
+                except ValueError:
+                    ipoc = None
+                if ipoc is None:
+                    corrected = relative
+                else:
+                    corrected = fit.add(ipoc, relative)
+                    residuals.append(relative - corrected)
+                # The recorded system time moves with the relative time
+                absolute = datetime.strptime(system_time, '%Y-%m-%d %H:%M:%S.%f').timestamp()
+                corrected_time = datetime.fromtimestamp(absolute + corrected - relative)
+                out.write(f"{system_time},{relative:.6f},{'' if ipoc is None else ipoc},"
+                          f"{corrected_time.strftime('%Y-%m-%d %H:%M:%S.%f')},{corrected:.6f}\n")
+    except Exception as e:
+        print(f"Error aligning timestamps: {e}")
+        return None
+
+    residuals.sort()
+    if residuals:
+        print(f"Clock: drift {fit.drift_ppm():.3f} ppm, fits={fit.fits}, outliers={fit.outliers}, "
+              f"resets={fit.resets}")
+        print(f"Residual (us): p50={residuals[len(residuals) // 2] * 1e6:.0f}, "
+              f"p99={residuals[int(len(residuals) * 0.99)] * 1e6:.0f}, max={residuals[-1] * 1e6:.0f}")
+    print(f"Aligned timestamps saved to: {output_file}")
+    return output_file
+
+def collect_raw_data(ip="192.168.1.25", port=59152, stop_flag=None,
+                     writer: RawDataWriter = None, monitor: IpocMonitor = None) -> List[Tuple[str, float, float]]:
+    """Collect raw XML data with absolute and relative timestamps until stopped.
+    With a writer the packets go to it as they arrive and are not kept in memory.
+    Each packet's IPOC is checked for lost, repeated, reordered and late packets
+    by monitor, or by a new IpocMonitor, and the counts are printed."""
     raw_data = []
+    count = 0
+    if monitor is None:
+        monitor = IpocMonitor()
     start_time = time.perf_counter() 
     
     with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
@@ -58,22 +448,32 @@ def collect_raw_data(ip="192.168.1.25", port=59152, stop_flag=None) -> List[Tupl
                 current_time = time.perf_counter()
                 relative_time = current_time - start_time
                 
-                if not raw_data:
+                if count == 0:
                     print("First data point received! Collection started.")
                 
-                raw_data.append((data.decode('utf-8'), time.time(), relative_time))
+                packet = (data.decode('utf-8'), time.time(), relative_time)
+                monitor.add_packet(packet[0], current_time)
+                if writer:
+                    writer.add(*packet)
+                else:
+                    raw_data.append(packet)
+                count += 1
                 
                 if current_time - last_report > 2:
-                    print(f"Collected {len(raw_data)} data points...")
+                    print(f"Collected {count} data points... ({monitor.status()})")
                     last_report = current_time
                     
             except socket.timeout:
+                if writer:
+                    writer.submit()
                 continue
             except Exception as e:
                 print(f"Error receiving data: {e}")
                 break
 
-    print(f"Collection stopped. Total points collected: {len(raw_data)}")
+    monitor.finish()
+    print(f"Collection stopped. Total points collected: {count}")
+    print(monitor.summary())
     return raw_data
 
 def save_raw_data(raw_data: List[Tuple[str, float, float]], filename: str = None) -> bool:
@@ -82,15 +482,7 @@ def save_raw_data(raw_data: List[Tuple[str, float, float]], filename: str = None
         print("No data collected to save!")
         return False
         
-    if not filename:
-        timestamp_str = datetime.now().strftime('%Y%m%d_%H%M%S')
-        filename = f"robot_raw_{timestamp_str}.txt"
-    
-    if not filename.endswith('.txt'):
-        filename += '.txt'
-    
-    if not os.path.isabs(filename):
-        filename = os.path.join(os.getcwd(), filename)
+    filename = raw_data_filename(filename)
     
     try:
         with open(filename, 'w', encoding='utf-8') as f:
@@ -98,9 +490,7 @@ def save_raw_data(raw_data: List[Tuple[str, float, float]], filename: str = None
             
             # Write data with formatted system time
             for xml_str, abs_time, rel_time in raw_data:
-                system_time = datetime.fromtimestamp(abs_time).strftime('%Y-%m-%d %H:%M:%S.%f')
-                safe_xml = xml_str.replace('|', '&#124;')
-                f.write(f"{system_time}|{rel_time:.6f}|{safe_xml}\n")
+                f.write(format_raw_line(xml_str, abs_time, rel_time))
                 
         print(f"\nData saved to: {filename}")
         print(f"File size: {os.path.getsize(filename)} bytes")
@@ -110,22 +500,112 @@ def save_raw_data(raw_data: List[Tuple[str, float, float]], filename: str = None
         print(f"Error saving data: {e}")
         return False
 
+RSI_RECEIVER = os.path.join(os.path.dirname(__file__), "RSIReceiver.exe")
+
+def start_native_collection(output_file, ip="192.168.1.25", port=59152, cpu=None,
+                            columns_file=None, fields=None, respond=False, hook=None, hook_args=None):
+    """Record with the native RSIReceiver, which writes the same file format as
+    save_raw_data while it runs.  columns_file also writes the parsed fields
+    (a list like ["RIst.X", "IPOC"], or the receiver's defaults) as CSV or, for
+    any other extension, the binary format read by load_columns.  respond
+    answers every packet with its IPOC and the correction from hook (a
+    library exporting RSIHookCorrect, see RSI/RSIHook.h), or zero without
+    one.  Returns the process for stop_native_collection."""
+    args = [RSI_RECEIVER, "--record", os.path.abspath(output_file), "--ip", ip, "--port", str(port)]
+    if cpu is not None:
+        args += ["--cpu", str(cpu)]
+    if columns_file:
+        args += ["--columns", os.path.abspath(columns_file)]
+        if fields:
+            args += ["--fields", ",".join(fields)]
+    if respond:
+        args += ["--respond"]
+        if hook:
+            args += ["--hook", os.path.abspath(hook)]
+        if hook_args:
+            args += ["--hook-args", hook_args]
+    try:
+        return subprocess.Popen(args, stdin=subprocess.PIPE, text=True)
+    except Exception as e:
+        print(f"Error starting RSI receiver: {e}")
+        return None
+
+def stop_native_collection(process, timeout=5):
+    """Ask RSIReceiver to finish writing and exit."""
+    if not process:
+        return
+    try:
+        process.communicate("q\n", timeout=timeout)
+    except subprocess.TimeoutExpired:
+        process.kill()
+    except Exception as e:
+        print(f"Error stopping RSI receiver: {e}")
+
+RSI_REPLAY = os.path.join(os.path.dirname(__file__), "RSIReplay.exe")
+
+def replay_raw_data(filename, ip="127.0.0.1", port=59152, speed=1.0, loops=1):
+    """Resend a save_raw_data recording to ip:port with the native RSIReplay,
+    at the recorded times divided by speed (0 = back to back).  Blocks until
+    done and returns its summary lines as a dict, e.g. {"SENT": "2500"}."""
+    args = [RSI_REPLAY, "--replay", os.path.abspath(filename), "--ip", ip, "--port", str(port),
+            "--speed", str(speed), "--loop", str(loops)]
+    try:
+        result = subprocess.run(args, capture_output=True, text=True)
+    except Exception as e:
+        print(f"Error starting RSI replay: {e}")
+        return {}
+    summary = {}
+    for line in result.stdout.splitlines():
+        key, sep, value = line.partition(":")
+        if sep and key.isupper():
+            summary[key] = value
+    return summary
+
+def load_columns(filename):
+    """Read a binary --columns file from RSIReceiver into a numpy structured
+    array, one field per column (unix_time_ns, relative_time, RIst.X, ...)."""
+    import numpy as np
+    with open(filename, "rb") as f:
+        if f.read(8) != b"RSICOLS1":
+            raise ValueError(f"{filename} is not an RSIReceiver column file")
+        header_length = int.from_bytes(f.read(4), "little")
+        header = f.read(header_length).decode("ascii")
+        dtype = np.dtype([(name, "<" + kind) for name, kind in
+                          (column.split(":") for column in header.split(","))])
+        return np.fromfile(f, dtype=dtype)
+
 def start_collection(ip="192.168.1.25", port=59152, output_file=None, 
-                    stop_flag=None, skip_verify=False) -> List[Tuple[str, float, float]]:
-    """Main interface function for collecting robot data"""
+                    stop_flag=None, skip_verify=False):
+    """Main interface function for collecting robot data.  With output_file the
+    packets are written to it while collecting and the number written is
+    returned; without one the packets are returned as a list.  Returns None
+    if the robot cannot be reached or the file cannot be opened."""
     if not skip_verify:
         is_connected, status = verify_connection(ip, port)
         if not is_connected:
             print(f"Robot connection failed: {status}")
-            return []
+            return None
 
     print("Starting raw data collection...")
-    raw_data = collect_raw_data(ip, port, stop_flag)
-    
-    if raw_data and output_file:
-        save_raw_data(raw_data, output_file)
-    
-    return raw_data
+    if not output_file:
+        return collect_raw_data(ip, port, stop_flag)
+
+    filename = raw_data_filename(output_file)
+    try:
+        writer = RawDataWriter(filename)
+    except Exception as e:
+        print(f"Error opening {filename}: {e}")
+        return None
+    try:
+        collect_raw_data(ip, port, stop_flag, writer)
+    finally:
+        writer.close()
+
+    print(f"\nData saved to: {filename}")
+    print(f"File size: {os.path.getsize(filename)} bytes")
+    if writer.dropped:
+        print(f"Warning: {writer.dropped} data points dropped, the disk could not keep up")
+    return writer.written
 
 if __name__ == "__main__":
     try:
@@ -0,0 +1,791 @@
+// Shared pieces of the native RSI tools: the UDP socket with batched,
+// kernel-timestamped receives, the host clock, thread pinning and a
+// single-producer/single-consumer ring.
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#include <mstcpip.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace RSI {
+
+const int DefaultPort = 59152;
+const char* const DefaultIp = "192.168.1.25";   // Same as RSI.py
+const size_t MaxPacketBytes = 2048;             // KUKA RSI packets are well under 1 KB
+const int MaxBatch = 64;                        // Datagrams per receive call
+
+// Host time in nanoseconds on a clock that never steps: CLOCK_MONOTONIC on
+// Linux, the performance counter on Windows (which SIO_TIMESTAMPING stamps
+// packets with).  Clock fits and intervals are all in this time, so an NTP
+// step or a manual clock change during a run moves nothing; it becomes
+// wall time only at the output, through one anchor read per process.
+class HostClock {
+public:
+    static int64_t NowNs() {
+#ifdef _WIN32
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return TicksToNs(counter.QuadPart);
+#else
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+    }
+
+#ifdef _WIN32
+    static int64_t TicksToNs(int64_t ticks) {
+        static const int64_t frequency = Frequency();
+        return (ticks / frequency) * 1000000000 + (ticks % frequency) * 1000000000 / frequency;
+    }
+#else
+    // CLOCK_REALTIME less NowNs() at this moment.  SO_TIMESTAMPNS stamps
+    // packets on CLOCK_REALTIME, so they are moved onto NowNs() with the
+    // offset read straight after the receive; a step only matters if it
+    // lands between the packet's arrival and that read.
+    static int64_t RealtimeOffsetNs() {
+        timespec real;
+        int64_t before = NowNs();
+        clock_gettime(CLOCK_REALTIME, &real);
+        int64_t after = NowNs();
+        return (int64_t)real.tv_sec * 1000000000 + real.tv_nsec - (before + (after - before) / 2);
+    }
+#endif
+
+    // Nanoseconds since 1970-01-01 UTC for a NowNs() value, from the wall
+    // clock as it was when first called
+    static int64_t ToUnixNs(int64_t hostNs) {
+        static const Anchor anchor = ReadAnchor();
+        return anchor.unixNs + (hostNs - anchor.hostNs);
+    }
+
+    // "YYYY-MM-DD HH:MM:SS.ffffff" in local time, as RSI.py writes it
+    static void FormatLocal(int64_t hostNs, char* out, size_t outSize) {
+        int64_t unixNs = ToUnixNs(hostNs);
+        time_t seconds = (time_t)(unixNs / 1000000000);
+        long micros = (long)((unixNs % 1000000000) / 1000);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &seconds);
+#else
+        localtime_r(&seconds, &local);
+#endif
+        size_t length = strftime(out, outSize, "%Y-%m-%d %H:%M:%S", &local);
+        snprintf(out + length, outSize - length, ".%06ld", micros);
+    }
+
+private:
+    struct Anchor {
+        int64_t hostNs;
+        int64_t unixNs;
+    };
+
+#ifdef _WIN32
+    static int64_t Frequency() {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return frequency.QuadPart;
+    }
+
+    static Anchor ReadAnchor() {
+        FILETIME fileTime;
+        Anchor anchor;
+        anchor.hostNs = NowNs();
+        GetSystemTimePreciseAsFileTime(&fileTime);
+        int64_t time100ns = ((int64_t)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime;
+        anchor.unixNs = (time100ns - 116444736000000000LL) * 100;
+        return anchor;
+    }
+#else
+    static Anchor ReadAnchor() {
+        Anchor anchor;
+        anchor.hostNs = NowNs();
+        anchor.unixNs = anchor.hostNs + RealtimeOffsetNs();
+        return anchor;
+    }
+#endif
+};
+
+// Pin the calling thread to one CPU and raise its priority.  Best effort,
+// returns false if the pinning was refused.
+inline bool PinCurrentThread(int cpu) {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    return cpu < 0 || SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else
+    sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);   // Needs privileges
+    if (cpu < 0) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// Last logical CPU, the default home of the socket thread
+inline int LastCpu() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 1 ? (int)count - 1 : -1;
+}
+
+// One datagram of a batch.  The caller points data at its buffer.
+struct ReceiveSlot {
+    char* data;
+    size_t capacity;
+    size_t length;
+    int64_t timeNs;           // Receive time, HostClock domain
+    bool kernelTime;          // Stamped by the network stack, not after the call returned
+    bool truncated;
+    sockaddr_storage from;
+    int fromLength;
+};
+
+class UdpSocket {
+public:
+    UdpSocket() { }
+    ~UdpSocket() { Close(); }
+
+    // Bind to ip:port.  Kernel receive timestamps are used when the stack
+    // supports them, see KernelTimestamps().
+    bool Open(const std::string& ip, int port) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            return false;
+        }
+        started = true;
+#endif
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == InvalidSocket) {
+            return false;
+        }
+
+        int bufferBytes = 4 * 1024 * 1024;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferBytes, sizeof(bufferBytes));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((unsigned short)port);
+        if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) != 1 ||
+            bind(sock, (const sockaddr*)&address, sizeof(address)) != 0) {
+            Close();
+            return false;
+        }
+
+#ifdef _WIN32
+        GUID recvMsgId = WSAID_WSARECVMSG;
+        DWORD bytes = 0;
+        if (WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &recvMsgId, sizeof(recvMsgId),
+                     &recvMsg, sizeof(recvMsg), &bytes, nullptr, nullptr) != 0) {
+            Close();
+            return false;
+        }
+#ifdef SIO_TIMESTAMPING
+        TIMESTAMPING_CONFIG config = {};
+        config.Flags = TIMESTAMPING_FLAG_RX;
+        kernelTimestamps = WSAIoctl(sock, SIO_TIMESTAMPING, &config, sizeof(config),
+                                    nullptr, 0, &bytes, nullptr, nullptr) == 0;
+#endif
+        // Drained without blocking after each wakeup
+        u_long nonBlocking = 1;
+        ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+        int on = 1;
+        kernelTimestamps = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+#endif
+        return true;
+    }
+
+    void Close() {
+        if (sock != InvalidSocket) {
+#ifdef _WIN32
+            closesocket(sock);
+#else
+            close(sock);
+#endif
+            sock = InvalidSocket;
+        }
+#ifdef _WIN32
+        if (started) {
+            WSACleanup();
+            started = false;
+        }
+#endif
+    }
+
+    bool KernelTimestamps() const { return kernelTimestamps; }
+
+    // Wait up to timeoutMs for a datagram, then take everything already
+    // queued, up to count.  Returns the number received, 0 on timeout and
+    // -1 on a socket error.
+    int ReceiveBatch(ReceiveSlot* slots, int count, int timeoutMs) {
+        if (count > MaxBatch) {
+            count = MaxBatch;
+        }
+#ifdef _WIN32
+        WSAPOLLFD poll = {};
+        poll.fd = sock;
+        poll.events = POLLRDNORM;
+        int ready = WSAPoll(&poll, 1, timeoutMs);
+        if (ready <= 0) {
+            return ready;
+        }
+
+        int received = 0;
+        while (received < count) {
+            ReceiveSlot& slot = slots[received];
+            char control[64];
+            WSABUF buffer;
+            WSAMSG message = {};
+            DWORD bytes = 0;
+            buffer.buf = slot.data;
+            buffer.len = (ULONG)slot.capacity;
+            slot.fromLength = sizeof(slot.from);
+            message.name = (LPSOCKADDR)&slot.from;
+            message.namelen = slot.fromLength;
+            message.lpBuffers = &buffer;
+            message.dwBufferCount = 1;
+            message.Control.buf = control;
+            message.Control.len = kernelTimestamps ? sizeof(control) : 0;
+            if (recvMsg(sock, &message, &bytes, nullptr, nullptr) != 0) {
+                int error = WSAGetLastError();
+                if (error == WSAEMSGSIZE) {
+                    bytes = buffer.len;
+                    message.dwFlags |= MSG_TRUNC;
+                } else if (error == WSAEWOULDBLOCK || received > 0) {
+                    break;
+                } else {
+                    return -1;
+                }
+            }
+            slot.length = bytes;
+            slot.fromLength = message.namelen;
+            slot.truncated = (message.dwFlags & MSG_TRUNC) != 0;
+            slot.kernelTime = false;
+#ifdef SIO_TIMESTAMPING
+            for (WSACMSGHDR* header = WSA_CMSG_FIRSTHDR(&message); header;
+                 header = WSA_CMSG_NXTHDR(&message, header)) {
+                if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SO_TIMESTAMP) {
+                    UINT64 ticks;
+                    memcpy(&ticks, WSA_CMSG_DATA(header), sizeof(ticks));
+                    slot.timeNs = HostClock::TicksToNs((int64_t)ticks);
+                    slot.kernelTime = true;
+                }
+            }
+#endif
+            received++;
+        }
+#else
+        mmsghdr messages[MaxBatch];
+        iovec buffers[MaxBatch];
+        char control[MaxBatch][CMSG_SPACE(sizeof(timespec))];
+        memset(messages, 0, sizeof(messages[0]) * count);
+        for (int i = 0; i < count; i++) {
+            buffers[i].iov_base = slots[i].data;
+            buffers[i].iov_len = slots[i].capacity;
+            messages[i].msg_hdr.msg_name = &slots[i].from;
+            messages[i].msg_hdr.msg_namelen = sizeof(slots[i].from);
+            messages[i].msg_hdr.msg_iov = &buffers[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = control[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+
+        if (timeoutMs != currentTimeoutMs) {
+            timeval timeout;
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_usec = (timeoutMs % 1000) * 1000;
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            currentTimeoutMs = timeoutMs;
+        }
+
+        // MSG_WAITFORONE: block for the first datagram only
+        int received = recvmmsg(sock, messages, count, MSG_WAITFORONE, nullptr);
+        if (received < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        int64_t realtimeOffset = HostClock::RealtimeOffsetNs();
+        for (int i = 0; i < received; i++) {
+            ReceiveSlot& slot = slots[i];
+            slot.length = messages[i].msg_len;
+            slot.fromLength = (int)messages[i].msg_hdr.msg_namelen;
+            slot.truncated = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            slot.kernelTime = false;
+            for (cmsghdr* header = CMSG_FIRSTHDR(&messages[i].msg_hdr); header;
+                 header = CMSG_NXTHDR(&messages[i].msg_hdr, header)) {
+                if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec stamp;
+                    memcpy(&stamp, CMSG_DATA(header), sizeof(stamp));
+                    slot.timeNs = (int64_t)stamp.tv_sec * 1000000000 + stamp.tv_nsec - realtimeOffset;
+                    slot.kernelTime = true;
+                }
+            }
+        }
+#endif
+        // Without a kernel stamp the best we have is now
+        int64_t now = HostClock::NowNs();
+        for (int i = 0; i < received; i++) {
+            if (!slots[i].kernelTime) {
+                slots[i].timeNs = now;
+            }
+        }
+        return received;
+    }
+
+    bool SendTo(const void* data, size_t length, const sockaddr* to, int toLength) {
+        return sendto(sock, (const char*)data, (int)length, 0, to, toLength) == (int)length;
+    }
+
+private:
+#ifdef _WIN32
+    typedef SOCKET SocketHandle;
+    static const SocketHandle InvalidSocket = INVALID_SOCKET;
+    LPFN_WSARECVMSG recvMsg = nullptr;
+    bool started = false;
+#else
+    typedef int SocketHandle;
+    static const SocketHandle InvalidSocket = -1;
+    int currentTimeoutMs = -1;
+#endif
+    SocketHandle sock = InvalidSocket;
+    bool kernelTimestamps = false;
+};
+
+// Lock-free ring between one producer thread and one consumer thread.
+// Capacity is a power of two; head and tail only grow.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacityPow2) :
+        slots(new T[capacityPow2]),
+        mask(capacityPow2 - 1),
+        head(0),
+        tail(0)
+    { }
+
+    size_t Capacity() const { return mask + 1; }
+
+    // Producer: contiguous free slots starting at the next one to fill
+    T* Reserve(size_t* count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = Capacity() - (h - tail.load(std::memory_order_acquire));
+        size_t contiguous = Capacity() - (h & mask);
+        *count = free < contiguous ? free : contiguous;
+        return &slots[h & mask];
+    }
+
+    void Commit(size_t count) {
+        head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // Consumer: contiguous filled slots starting at the oldest
+    T* Peek(size_t* count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t filled = head.load(std::memory_order_acquire) - t;
+        size_t contiguous = Capacity() - (t & mask);
+        *count = filled < contiguous ? filled : contiguous;
+        return &slots[t & mask];
+    }
+
+    void Release(size_t count) {
+        tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    size_t Size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::unique_ptr<T[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+// Microsecond histogram with an overflow bucket
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(size_t buckets = 20000) : counts(buckets, 0) { }
+
+    void Add(int64_t ns) {
+        uint64_t us = ns > 0 ? (uint64_t)(ns / 1000) : 0;
+        counts[us < counts.size() ? us : counts.size() - 1]++;
+        total++;
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+        sumNs += ns;
+    }
+
+    uint64_t Count() const { return total; }
+    double MaxUs() const { return maxNs / 1000.0; }
+    double MeanUs() const { return total ? sumNs / 1000.0 / total : 0.0; }
+
+    // Upper edge of the bucket holding the fraction, clamped to the maximum
+    double PercentileUs(double fraction) const {
+        uint64_t target = (uint64_t)(fraction * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen > target) {
+                return (double)(i + 1) < MaxUs() ? (double)(i + 1) : MaxUs();
+            }
+        }
+        return MaxUs();
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    int64_t maxNs = 0;
+    double sumNs = 0.0;
+};
+
+// Follows the robot's IPOC counter (milliseconds, one step per IPO cycle)
+// to count lost, repeated and reordered packets, and times each arrival
+// against the cycle it belongs to.  With period 0 the period is the
+// smallest step among the first packets.  Counters can be read from
+// another thread while Add runs.
+class IpocMonitor {
+public:
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> missing{0};      // Cycles never seen, net of late arrivals
+    std::atomic<uint64_t> gaps{0};         // Jumps over one or more cycles, even if filled in later
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> reordered{0};    // Arrived after a later cycle
+    std::atomic<uint64_t> late{0};         // More than one period behind its slot
+    uint64_t maxGap = 0;
+    LatencyHistogram jitter;               // |interval - cycles * period| between arrivals
+    LatencyHistogram lateness;             // Behind the earliest arrival slot of the last few seconds
+
+    explicit IpocMonitor(int64_t periodMs = 0) : period(periodMs) { }
+
+    int64_t PeriodMs() const { return period; }
+
+    void Add(int64_t ipoc, int64_t timeNs) {
+        packets++;
+        if (period == 0) {
+            // Learn the period before counting anything
+            pending.push_back(std::make_pair(ipoc, timeNs));
+            if (pending.size() < LearnPackets) {
+                return;
+            }
+            Learn();
+            return;
+        }
+        Track(ipoc, timeNs);
+    }
+
+    // Count packets still held back while learning the period
+    void Finish() {
+        if (period == 0 && !pending.empty()) {
+            Learn();
+        }
+    }
+
+private:
+    static const size_t LearnPackets = 16;
+    static const int64_t Window = 1024;    // Cycles remembered for duplicates and reordering
+    static const int64_t LatenessBlock = 1024;
+
+    int64_t period;
+    std::vector<std::pair<int64_t, int64_t>> pending;
+    bool started = false;
+    int64_t firstIpoc = 0;
+    int64_t highest = 0;                   // Highest cycle seen
+    int64_t highestTimeNs = 0;
+    bool seen[Window] = {};
+    int64_t blockMin = INT64_MAX;          // Earliest slot offsets, this block and the last
+    int64_t previousBlockMin = INT64_MAX;
+    int64_t blockCount = 0;
+
+    void Learn() {
+        int64_t step = 0;
+        for (size_t i = 1; i < pending.size(); i++) {
+            int64_t diff = pending[i].first - pending[i - 1].first;
+            if (diff > 0 && (step == 0 || diff < step)) {
+                step = diff;
+            }
+        }
+        period = step > 0 ? step : 4;
+        for (const auto& packet : pending) {
+            Track(packet.first, packet.second);
+        }
+        pending.clear();
+        pending.shrink_to_fit();
+    }
+
+    void Track(int64_t ipoc, int64_t timeNs) {
+        if (!started) {
+            started = true;
+            firstIpoc = ipoc;
+            highest = 0;
+            highestTimeNs = timeNs;
+            seen[0] = true;
+            Lateness(0, timeNs);
+            return;
+        }
+
+        int64_t cycle = (ipoc - firstIpoc) / period;
+        if (cycle > highest) {
+            int64_t skipped = cycle - highest - 1;
+            if (skipped > 0) {
+                missing += skipped;
+                gaps++;
+                if ((uint64_t)skipped > maxGap) {
+                    maxGap = skipped;
+                }
+            }
+            for (int64_t c = highest + 1; c < cycle && c <= highest + Window; c++) {
+                seen[Slot(c)] = false;
+            }
+            seen[Slot(cycle)] = true;
+
+            int64_t interval = timeNs - highestTimeNs;
+            int64_t expected = (cycle - highest) * period * 1000000;
+            jitter.Add(interval > expected ? interval - expected : expected - interval);
+            highest = cycle;
+            highestTimeNs = timeNs;
+        } else if (highest - cycle < Window && cycle >= 0) {
+            if (seen[Slot(cycle)]) {
+                duplicates++;
+                return;
+            }
+            seen[Slot(cycle)] = true;
+            reordered++;
+            if (missing > 0) {
+                missing--;
+            }
+        } else {
+            // Too old to tell a repeat from a late arrival
+            reordered++;
+            return;
+        }
+        Lateness(cycle, timeNs);
+    }
+
+    void Lateness(int64_t cycle, int64_t timeNs) {
+        int64_t offset = timeNs - cycle * period * 1000000;
+        if (offset < blockMin) {
+            blockMin = offset;
+        }
+        int64_t baseline = blockMin < previousBlockMin ? blockMin : previousBlockMin;
+        lateness.Add(offset - baseline);
+        if (offset - baseline > period * 1000000) {
+            late++;
+        }
+        if (++blockCount == LatenessBlock) {
+            previousBlockMin = blockMin;
+            blockMin = INT64_MAX;
+            blockCount = 0;
+        }
+    }
+
+    static size_t Slot(int64_t cycle) {
+        return (size_t)(cycle % Window);
+    }
+};
+
+// Maps a device's tick counter onto HostClock time: the robot's IPOC
+// (controller milliseconds, the default) or an audio device's sample count.
+// Network and scheduling delays only ever add to a receive time, so each
+// block of packets contributes its least-delayed packet as a floor point,
+// and a line is fitted through the floor points of the last minute or so.
+// Its slope gives the drift between the two clocks.  A floor point far
+// above the line (a block where every packet was delayed) is left out;
+// several in a row mean the clocks really moved, and the fit starts over.
+// The corrected time of a packet is the line at its tick, i.e. when it
+// would have arrived with the least delay seen, so receive jitter is gone
+// but the constant part of the transport delay remains.
+class ClockFit {
+public:
+    uint64_t fits = 0;
+    uint64_t outliers = 0;
+    uint64_t resets = 0;
+    LatencyHistogram residual;             // Receive time after the corrected time
+
+    explicit ClockFit(int blockPackets = 250, size_t windowBlocks = 60, double tickNs = 1e6) :
+        blockSize(blockPackets),
+        window(windowBlocks),
+        nsPerTick(tickNs),
+        resetGap((int64_t)(ResetGapNs / tickNs)),
+        slope(tickNs) { }
+
+    // Corrected HostClock time for a packet received at hostNs
+    int64_t Add(int64_t tick, int64_t hostNs) {
+        if (!started || tick + resetGap < lastTick || tick - lastTick > resetGap) {
+            // First packet, or the device's counter jumped
+            if (started) {
+                resets++;
+            }
+            Reset(tick, hostNs);
+        }
+        if (tick > lastTick) {
+            lastTick = tick;
+        }
+
+        double x = (double)(tick - tick0);
+        double y = (double)(hostNs - host0);
+        if (y - x * nsPerTick < blockFloor) {
+            blockFloor = y - x * nsPerTick;
+            blockX = x;
+            blockY = y;
+        }
+        if (y - x * nsPerTick < floorOffset) {
+            floorOffset = y - x * nsPerTick;
+        }
+        if (++blockCount == blockSize) {
+            AddPoint(blockX, blockY);
+            blockCount = 0;
+            blockFloor = 1e300;
+        }
+
+        double corrected = Fitted() ? intercept + slope * x : floorOffset + x * nsPerTick;
+        residual.Add((int64_t)(y - corrected));
+        return host0 + (int64_t)corrected;
+    }
+
+    bool Fitted() const { return points.size() >= 2; }
+    // Positive when the device's clock runs fast against the host's
+    double DriftPpm() const { return Fitted() ? (nsPerTick / slope - 1.0) * 1e6 : 0.0; }
+
+    // HostClock time of tick 0 on the current line
+    int64_t OffsetNs() const {
+        return host0 + (int64_t)((Fitted() ? intercept : floorOffset) - tick0 * (Fitted() ? slope : nsPerTick));
+    }
+
+    // Fitted nanoseconds per tick
+    double TickNs() const { return Fitted() ? slope : nsPerTick; }
+
+private:
+    static constexpr double ResetGapNs = 60e9;
+    static const int RejectLimit = 5;
+
+    int blockSize;
+    size_t window;
+    double nsPerTick;                      // Nominal
+    int64_t resetGap;                      // Ticks
+    bool started = false;
+    int64_t tick0 = 0;
+    int64_t host0 = 0;
+    int64_t lastTick = 0;
+    int blockCount = 0;
+    double blockFloor = 1e300;
+    double blockX = 0;
+    double blockY = 0;
+    double floorOffset = 1e300;            // Used until there is a line
+    std::vector<std::pair<double, double>> points;
+    double intercept = 0;
+    double slope;
+    int rejected = 0;
+
+    void Reset(int64_t tick, int64_t hostNs) {
+        started = true;
+        tick0 = tick;
+        host0 = hostNs;
+        lastTick = tick;
+        blockCount = 0;
+        blockFloor = 1e300;
+        floorOffset = 1e300;
+        points.clear();
+        slope = nsPerTick;
+        intercept = 0;
+        rejected = 0;
+    }
+
+    void AddPoint(double x, double y) {
+        if (points.size() >= 3) {
+            // Spread of the kept points around the line, median absolute residual
+            std::vector<double> spread;
+            for (const auto& point : points) {
+                double r = point.second - (intercept + slope * point.first);
+                spread.push_back(r < 0 ? -r : r);
+            }
+            std::nth_element(spread.begin(), spread.begin() + spread.size() / 2, spread.end());
+            double limit = 3.0 * spread[spread.size() / 2];
+            if (limit < MinRejectNs) {
+                limit = MinRejectNs;
+            }
+            if (y - (intercept + slope * x) > limit) {
+                outliers++;
+                if (++rejected < RejectLimit) {
+                    return;
+                }
+                // The clocks moved; keep only the new level
+                resets++;
+                points.clear();
+            }
+        }
+        rejected = 0;
+        points.push_back(std::make_pair(x, y));
+        if (points.size() > window) {
+            points.erase(points.begin());
+        }
+        Fit();
+    }
+
+    // Least squares about the means, so large x and y keep their precision
+    void Fit() {
+        if (points.size() < 2) {
+            return;
+        }
+        double meanX = 0;
+        double meanY = 0;
+        for (const auto& point : points) {
+            meanX += point.first;
+            meanY += point.second;
+        }
+        meanX /= points.size();
+        meanY /= points.size();
+        double sxx = 0;
+        double sxy = 0;
+        for (const auto& point : points) {
+            sxx += (point.first - meanX) * (point.first - meanX);
+            sxy += (point.first - meanX) * (point.second - meanY);
+        }
+        if (sxx <= 0) {
+            return;
+        }
+        slope = sxy / sxx;
+        intercept = meanY - slope * meanX;
+        fits++;
+    }
+
+    static constexpr double MinRejectNs = 200000;
+};
+
+}  // namespace RSI
@@ -0,0 +1,55 @@
+/* Correction hook for RSIReceiver --respond.
+ *
+ * A hook is a DLL (shared library on Linux) loaded with --hook.  It exports
+ *
+ *     RSIHookCorrect   required, called for every packet
+ *     RSIHookOpen      optional, called once with the --hook-args string
+ *     RSIHookClose     optional, called once at the end of the run
+ *
+ * RSIHookCorrect runs on the socket thread between the packet arriving and
+ * the reply going out, so it has to return in well under a millisecond:
+ * read the latest sensor values, do not wait for new ones.  The reply
+ * carries the correction as <RKorr X=... C=...>, so its meaning (relative
+ * or absolute, mm and degrees) follows the RSI Visual configuration.
+ */
+#ifndef RSIHOOK_H
+#define RSIHOOK_H
+
+#ifdef _WIN32
+#define RSI_HOOK_API __declspec(dllexport)
+#else
+#define RSI_HOOK_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What the robot sent this cycle.  Fields missing from the packet are NaN,
+ * or 0 for the integers. */
+typedef struct {
+    long long ipoc;
+    long long receiveTimeNs;          /* Unix time */
+    double rist[6];                   /* Actual TCP X Y Z A B C */
+    double rsol[6];                   /* Commanded TCP */
+    double aipos[6];                  /* Actual axes A1-A6 */
+    long long digin;
+    long long delay;                  /* Late packets the robot has counted */
+} RSI_CYCLE;
+
+/* Filled in by the hook; all zero on entry */
+typedef struct {
+    double rkorr[6];                  /* X Y Z A B C */
+} RSI_CORRECTION;
+
+/* Return 0 to go on; non-zero stops RSIReceiver (Open) or sends a zero
+ * correction and counts a hook error (Correct) */
+typedef int (*RSI_HOOK_OPEN)(const char* args);
+typedef int (*RSI_HOOK_CORRECT)(const RSI_CYCLE* cycle, RSI_CORRECTION* correction);
+typedef void (*RSI_HOOK_CLOSE)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,519 @@
+// Streaming parser for KUKA RSI packets.  Scans the XML in place, without
+// copying or allocating, and picks out the configured fields ("RIst.X" for
+// an attribute, "IPOC" for element text) as typed values, plus the span of
+// the original text so CSV output can copy it unchanged.
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "RSICommon.h"
+
+namespace RSI {
+
+enum class ColumnType : uint8_t { Float64 = 1, Int64 = 2 };
+
+// One parsed value; which member is valid follows the column type
+struct FieldValue {
+    union {
+        double number;
+        int64_t integer;
+    };
+    const char* text;         // Original text inside the packet
+    uint32_t textLength;      // 0 when the field was not in the packet
+};
+
+// Fields the default RSI Visual configuration sends
+inline std::vector<std::string> DefaultFields() {
+    std::vector<std::string> fields;
+    const char* cartesian[] = { "X", "Y", "Z", "A", "B", "C" };
+    const char* axes[] = { "A1", "A2", "A3", "A4", "A5", "A6" };
+    for (const char* name : cartesian) fields.push_back(std::string("RIst.") + name);
+    for (const char* name : cartesian) fields.push_back(std::string("RSol.") + name);
+    for (const char* name : axes) fields.push_back(std::string("AIPos.") + name);
+    for (const char* name : axes) fields.push_back(std::string("ASPos.") + name);
+    fields.push_back("Delay.D");
+    fields.push_back("Digin");
+    fields.push_back("IPOC");
+    return fields;
+}
+
+// Fields parsed into values[ColumnCount()], as ColumnWriter consumes them.
+// RSIParser takes its field list at run time; RSISchemaGen generates one
+// for a fixed RSI configuration.
+class FieldParser {
+public:
+    virtual ~FieldParser() { }
+    virtual size_t ColumnCount() const = 0;
+    virtual const char* ColumnName(size_t column) const = 0;
+    virtual ColumnType Type(size_t column) const = 0;
+
+    // Fields missing from the packet get NaN or INT64_MIN and an empty text
+    // span.  Returns the number of fields found.
+    virtual int Parse(const char* data, size_t length, FieldValue* values) const = 0;
+};
+
+class RSIParser : public FieldParser {
+private:
+    struct AttributeSpec {
+        std::string name;
+        int column;
+    };
+
+    struct ElementSpec {
+        std::string name;
+        std::vector<AttributeSpec> attributes;
+        int textColumn;       // -1 when the element text is not wanted
+    };
+
+    std::vector<ElementSpec> elements;
+    std::vector<std::string> columnNames;
+    std::vector<ColumnType> columnTypes;
+
+public:
+    // fields: "Element.Attribute" or "Element" for its text.  IPOC, Digin,
+    // Digout and Delay are integers, everything else is a double.
+    explicit RSIParser(const std::vector<std::string>& fields) {
+        for (const std::string& field : fields) {
+            size_t dot = field.find('.');
+            std::string element = field.substr(0, dot);
+            ElementSpec* spec = FindSpec(element.c_str(), element.size());
+            if (!spec) {
+                elements.push_back(ElementSpec{ element, {}, -1 });
+                spec = &elements.back();
+            }
+            int column = (int)columnNames.size();
+            if (dot == std::string::npos) {
+                spec->textColumn = column;
+            } else {
+                spec->attributes.push_back(AttributeSpec{ field.substr(dot + 1), column });
+            }
+            columnNames.push_back(field);
+            bool integer = element == "IPOC" || element == "Digin" || element == "Digout" || element == "Delay";
+            columnTypes.push_back(integer ? ColumnType::Int64 : ColumnType::Float64);
+        }
+    }
+
+    size_t ColumnCount() const override { return columnNames.size(); }
+    const char* ColumnName(size_t column) const override { return columnNames[column].c_str(); }
+    ColumnType Type(size_t column) const override { return columnTypes[column]; }
+
+    int Parse(const char* data, size_t length, FieldValue* values) const override {
+        const char* p = data;
+        const char* end = data + length;
+        int found = 0;
+
+        for (size_t i = 0; i < columnNames.size(); i++) {
+            SetMissing(values[i], columnTypes[i]);
+        }
+
+        while (true) {
+            p = (const char*)memchr(p, '<', end - p);
+            if (!p || ++p >= end) {
+                break;
+            }
+            if (*p == '/' || *p == '?' || *p == '!') {
+                continue;
+            }
+
+            const char* name = p;
+            while (p < end && !IsSpace(*p) && *p != '>' && *p != '/') {
+                p++;
+            }
+            const ElementSpec* spec = FindSpec(name, p - name);
+            if (!spec) {
+                continue;
+            }
+
+            // Attributes up to the end of the start tag
+            bool selfClosing = false;
+            while (p < end) {
+                while (p < end && IsSpace(*p)) {
+                    p++;
+                }
+                if (p >= end) {
+                    break;
+                }
+                if (*p == '>') {
+                    p++;
+                    break;
+                }
+                if (*p == '/') {
+                    selfClosing = true;
+                    p++;
+                    continue;
+                }
+                const char* attribute = p;
+                while (p < end && *p != '=' && !IsSpace(*p) && *p != '>') {
+                    p++;
+                }
+                size_t attributeLength = p - attribute;
+                while (p < end && *p != '"' && *p != '\'') {
+                    p++;
+                }
+                if (p >= end) {
+                    break;
+                }
+                char quote = *p++;
+                const char* value = p;
+                p = (const char*)memchr(p, quote, end - p);
+                if (!p) {
+                    return found;
+                }
+                for (const AttributeSpec& wanted : spec->attributes) {
+                    if (wanted.name.size() == attributeLength &&
+                        memcmp(wanted.name.data(), attribute, attributeLength) == 0) {
+                        found += SetValue(values[wanted.column], columnTypes[wanted.column], value, p);
+                        break;
+                    }
+                }
+                p++;
+            }
+
+            if (spec->textColumn >= 0 && !selfClosing && p < end) {
+                const char* text = p;
+                const char* textEnd = (const char*)memchr(p, '<', end - p);
+                if (!textEnd) {
+                    textEnd = end;
+                }
+                found += SetValue(values[spec->textColumn], columnTypes[spec->textColumn], text, textEnd);
+                p = textEnd;
+            }
+        }
+        return found;
+    }
+
+    // Decimal number without allocation.  Up to 15 significant digits are
+    // converted exactly (integer mantissa over an exact power of ten), the
+    // rare longer or exponent forms go through strtod.
+    static bool ParseDouble(const char* p, const char* end, double* out) {
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                         1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+                                         1e20, 1e21, 1e22 };
+        const char* start = p;
+        bool negative = false;
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int decimals = 0;
+
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = (*p++ == '-');
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10 + (*p++ - '0');
+            digits++;
+        }
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && *p >= '0' && *p <= '9') {
+                mantissa = mantissa * 10 + (*p++ - '0');
+                digits++;
+                decimals++;
+            }
+        }
+        if (digits == 0) {
+            return false;
+        }
+        if (p == end && digits <= 15 && decimals <= 22) {
+            double value = (double)mantissa / powers[decimals];
+            *out = negative ? -value : value;
+            return true;
+        }
+
+        char buffer[64];
+        size_t length = end - start;
+        if (length >= sizeof(buffer)) {
+            return false;
+        }
+        memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        char* parsedEnd;
+        *out = strtod(buffer, &parsedEnd);
+        return parsedEnd == buffer + length;
+    }
+
+    static bool ParseInteger(const char* p, const char* end, int64_t* out) {
+        bool negative = false;
+        uint64_t value = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = (*p++ == '-');
+        }
+        if (p == end) {
+            return false;
+        }
+        while (p < end) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            value = value * 10 + (*p++ - '0');
+        }
+        *out = negative ? -(int64_t)value : (int64_t)value;
+        return true;
+    }
+
+    static bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static void SetMissing(FieldValue& value, ColumnType type) {
+        if (type == ColumnType::Float64) {
+            value.number = std::numeric_limits<double>::quiet_NaN();
+        } else {
+            value.integer = std::numeric_limits<int64_t>::min();
+        }
+        value.text = nullptr;
+        value.textLength = 0;
+    }
+
+    static int SetValue(FieldValue& value, ColumnType type, const char* text, const char* textEnd) {
+        while (text < textEnd && IsSpace(*text)) {
+            text++;
+        }
+        while (textEnd > text && IsSpace(textEnd[-1])) {
+            textEnd--;
+        }
+        bool parsed = (type == ColumnType::Float64) ? ParseDouble(text, textEnd, &value.number)
+                                                    : ParseInteger(text, textEnd, &value.integer);
+        if (!parsed) {
+            SetMissing(value, type);
+            return 0;
+        }
+        value.text = text;
+        value.textLength = (uint32_t)(textEnd - text);
+        return 1;
+    }
+
+private:
+    const ElementSpec* FindSpec(const char* name, size_t length) const {
+        for (const ElementSpec& spec : elements) {
+            if (spec.name.size() == length && memcmp(spec.name.data(), name, length) == 0) {
+                return &spec;
+            }
+        }
+        return nullptr;
+    }
+
+    ElementSpec* FindSpec(const char* name, size_t length) {
+        return const_cast<ElementSpec*>(static_cast<const RSIParser*>(this)->FindSpec(name, length));
+    }
+};
+
+// Building blocks for the parsers RSISchemaGen generates.  The generated
+// code visits the configured elements and attributes in the order the
+// robot sends them, so each search starts where the last one ended and
+// usually finds its target straight away.  If the order differs, the
+// search starts over from the top of the packet, or of the start tag.
+class SchemaScanner {
+private:
+    const char* begin;
+    const char* end;
+    const char* cursor;
+    const char* tagStart;        // Just past the element name
+    const char* tagEnd;          // The start tag's '>'
+    const char* attributeCursor;
+    bool selfClosing;
+
+public:
+    SchemaScanner(const char* data, size_t length) :
+        begin(data), end(data + length), cursor(data),
+        tagStart(nullptr), tagEnd(nullptr), attributeCursor(nullptr), selfClosing(false)
+    { }
+
+    // open is "<Name"; false when the element is not in the packet
+    bool Element(const char* open, size_t openLength) {
+        const char* found = FindElement(cursor, open, openLength);
+        if (!found && cursor != begin) {
+            found = FindElement(begin, open, openLength);
+        }
+        if (!found) {
+            tagStart = nullptr;
+            return false;
+        }
+        tagStart = found + openLength;
+        tagEnd = (const char*)memchr(tagStart, '>', end - tagStart);
+        if (!tagEnd) {
+            tagStart = nullptr;
+            return false;
+        }
+        selfClosing = tagEnd[-1] == '/';
+        attributeCursor = tagStart;
+        cursor = tagEnd + 1;
+        return true;
+    }
+
+    // name is the attribute name followed by '=', e.g. "X="
+    int Attribute(const char* name, size_t nameLength, ColumnType type, FieldValue& value) {
+        const char* found = tagStart ? FindAttribute(attributeCursor, name, nameLength) : nullptr;
+        if (!found && tagStart && attributeCursor != tagStart) {
+            found = FindAttribute(tagStart, name, nameLength);
+        }
+        if (!found) {
+            RSIParser::SetMissing(value, type);
+            return 0;
+        }
+        const char* quote = found + nameLength;
+        if (quote >= tagEnd || (*quote != '"' && *quote != '\'')) {
+            RSIParser::SetMissing(value, type);
+            return 0;
+        }
+        const char* close = (const char*)memchr(quote + 1, *quote, tagEnd - quote - 1);
+        if (!close) {
+            RSIParser::SetMissing(value, type);
+            return 0;
+        }
+        attributeCursor = close + 1;
+        return RSIParser::SetValue(value, type, quote + 1, close);
+    }
+
+    // Text of the current element, up to the next tag
+    int Text(ColumnType type, FieldValue& value) {
+        if (!tagStart || selfClosing) {
+            RSIParser::SetMissing(value, type);
+            return 0;
+        }
+        const char* close = (const char*)memchr(tagEnd + 1, '<', end - tagEnd - 1);
+        return RSIParser::SetValue(value, type, tagEnd + 1, close ? close : end);
+    }
+
+private:
+    const char* FindElement(const char* from, const char* open, size_t openLength) const {
+        while (from + openLength < end) {
+            from = (const char*)memchr(from, '<', end - from - openLength);
+            if (!from) {
+                return nullptr;
+            }
+            char next = from[openLength];
+            if (memcmp(from, open, openLength) == 0 &&
+                (next == '>' || next == '/' || RSIParser::IsSpace(next))) {
+                return from;
+            }
+            from++;
+        }
+        return nullptr;
+    }
+
+    const char* FindAttribute(const char* from, const char* name, size_t nameLength) const {
+        while (from + nameLength <= tagEnd) {
+            from = (const char*)memchr(from, name[0], tagEnd - from - nameLength + 1);
+            if (!from) {
+                return nullptr;
+            }
+            if (RSIParser::IsSpace(from[-1]) && memcmp(from, name, nameLength) == 0) {
+                return from;
+            }
+            from++;
+        }
+        return nullptr;
+    }
+};
+
+// Parsed fields written as one row per packet, after the receive time and
+// the receive time corrected by the IPOC clock fit (see ClockFit).
+//   .csv  SystemTime,RelativeTime,CorrectedTime,CorrectedRelativeTime,<fields>;
+//         values are the packet's own text
+//   other binary: "RSICOLS1", a uint32 header length, the header
+//         "unix_time_ns:i8,relative_time:f8,corrected_unix_ns:i8,
+//         corrected_relative_time:f8,RIst.X:f8,...", then fixed
+//         little-endian rows of 8-byte values.  Missing values are NaN or
+//         INT64_MIN.  numpy.fromfile with a structured dtype reads it.
+class ColumnWriter {
+private:
+    static const size_t TimeColumns = 4;
+
+    FILE* file;
+    bool csv;
+    const FieldParser* parser;
+    std::vector<char> row;
+    std::string line;
+
+public:
+    ColumnWriter() : file(nullptr), csv(false), parser(nullptr) { }
+    ~ColumnWriter() { Close(); }
+
+    bool Open(const std::string& path, const FieldParser& fields) {
+        parser = &fields;
+        csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+        std::string header = csv ? "SystemTime,RelativeTime,CorrectedTime,CorrectedRelativeTime"
+                                 : "unix_time_ns:i8,relative_time:f8,corrected_unix_ns:i8,corrected_relative_time:f8";
+        for (size_t i = 0; i < parser->ColumnCount(); i++) {
+            header += ',';
+            header += parser->ColumnName(i);
+            if (!csv) {
+                header += parser->Type(i) == ColumnType::Int64 ? ":i8" : ":f8";
+            }
+        }
+        if (csv) {
+            header += '\n';
+        } else {
+            uint32_t headerLength = (uint32_t)header.size();
+            fwrite("RSICOLS1", 1, 8, file);
+            fwrite(&headerLength, sizeof(headerLength), 1, file);
+        }
+        fwrite(header.data(), 1, header.size(), file);
+        row.resize((TimeColumns + parser->ColumnCount()) * 8);
+        return true;
+    }
+
+    // HostClock times; relative times count from startNs
+    bool WriteRow(int64_t hostNs, int64_t correctedNs, int64_t startNs, const FieldValue* values) {
+        double relative = (hostNs - startNs) / 1e9;
+        double correctedRelative = (correctedNs - startNs) / 1e9;
+        if (csv) {
+            char time[40];
+            char corrected[40];
+            char relativeText[64];
+            HostClock::FormatLocal(hostNs, time, sizeof(time));
+            HostClock::FormatLocal(correctedNs, corrected, sizeof(corrected));
+            line.assign(time);
+            snprintf(relativeText, sizeof(relativeText), ",%.6f,", relative);
+            line += relativeText;
+            line += corrected;
+            snprintf(relativeText, sizeof(relativeText), ",%.6f", correctedRelative);
+            line += relativeText;
+            for (size_t i = 0; i < parser->ColumnCount(); i++) {
+                line += ',';
+                line.append(values[i].text ? values[i].text : "", values[i].textLength);
+            }
+            line += '\n';
+            return fwrite(line.data(), 1, line.size(), file) == line.size();
+        }
+
+        int64_t unixNs = HostClock::ToUnixNs(hostNs);
+        int64_t correctedUnixNs = HostClock::ToUnixNs(correctedNs);
+        memcpy(&row[0], &unixNs, 8);
+        memcpy(&row[8], &relative, 8);
+        memcpy(&row[16], &correctedUnixNs, 8);
+        memcpy(&row[24], &correctedRelative, 8);
+        for (size_t i = 0; i < parser->ColumnCount(); i++) {
+            memcpy(&row[TimeColumns * 8 + i * 8], &values[i].integer, 8);
+        }
+        return fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+
+    void Flush() {
+        if (file) {
+            fflush(file);
+        }
+    }
+
+    void Close() {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+};
+
+}  // namespace RSI
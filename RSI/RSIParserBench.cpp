@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "RSIParser.h"
+
+#ifdef RSI_SCHEMA
+#include "RSISchema.h"
+#endif
+
+// Counts heap allocations so the benchmark can show the parse loop makes none
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    void* memory = malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// Packets shaped like RobotSim's, with a moving TCP and IPOC
+static std::vector<std::string> SyntheticPackets(size_t count) {
+    std::vector<std::string> packets;
+    char text[1024];
+    for (size_t i = 0; i < count; i++) {
+        double t = i * 0.004;
+        double x = 445.0 + 10.0 * t;
+        double y = 2.0 * sin(2.0 * 3.14159265358979 * 2.0 * t);
+        snprintf(text, sizeof(text),
+                 "<Rob Type=\"KUKA\">"
+                 "<RIst X=\"%.4f\" Y=\"%.4f\" Z=\"900.0000\" A=\"180.0000\" B=\"0.0000\" C=\"180.0000\"/>"
+                 "<RSol X=\"%.4f\" Y=\"%.4f\" Z=\"900.0000\" A=\"180.0000\" B=\"0.0000\" C=\"180.0000\"/>"
+                 "<AIPos A1=\"%.4f\" A2=\"-90.0000\" A3=\"90.0000\" A4=\"0.0000\" A5=\"0.0000\" A6=\"0.0000\"/>"
+                 "<ASPos A1=\"%.4f\" A2=\"-90.0000\" A3=\"90.0000\" A4=\"0.0000\" A5=\"0.0000\" A6=\"0.0000\"/>"
+                 "<Delay D=\"0\"/><Digin>%u</Digin><IPOC>%llu</IPOC></Rob>",
+                 x, y, x, y, y / x, y / x, (unsigned)(i / 250 % 2), (unsigned long long)(4208050 + 4 * i));
+        packets.push_back(text);
+    }
+    return packets;
+}
+
+// The XML column of a SystemTime|RelativeTime|XML recording
+static std::vector<std::string> RecordedPackets(const std::string& path) {
+    std::vector<std::string> packets;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t bar = line.find('|', line.find('|') + 1);
+        if (bar != std::string::npos) {
+            packets.push_back(line.substr(bar + 1));
+        }
+    }
+    return packets;
+}
+
+struct BenchResult {
+    uint64_t found;
+    double seconds;
+    double checksum;
+};
+
+static BenchResult Time(const RSI::FieldParser& parser, const std::vector<std::string>& packets, uint64_t total) {
+    RSI::FieldValue values[256];
+    BenchResult result = { 0, 0.0, 0.0 };
+    if (parser.ColumnCount() > 256) {
+        return result;
+    }
+
+    // Touch every packet once before timing
+    for (const std::string& packet : packets) {
+        parser.Parse(packet.data(), packet.size(), values);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < total; i++) {
+        const std::string& packet = packets[i % packets.size()];
+        result.found += parser.Parse(packet.data(), packet.size(), values);
+        result.checksum += values[0].number;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static void Print(const char* prefix, const RSI::FieldParser& parser, const BenchResult& result, uint64_t total) {
+    printf("%sFIELDS:%zu\n", prefix, parser.ColumnCount());
+    printf("%sFIELDS_FOUND_PER_PACKET:%.2f\n", prefix, (double)result.found / total);
+    printf("%sNS_PER_PACKET:%.1f\n", prefix, result.seconds * 1e9 / total);
+    printf("%sPACKETS_PER_S:%.0f\n", prefix, total / result.seconds);
+    printf("%sHEADROOM_AT_250HZ:%.0fx\n", prefix, total / result.seconds / 250.0);
+    printf("%sCHECKSUM:%.4f\n", prefix, result.checksum);
+}
+
+#ifdef RSI_SCHEMA
+// Fields whose value or presence differs between the two parsers
+static uint64_t Compare(const RSI::FieldParser& a, const RSI::FieldParser& b, const std::vector<std::string>& packets) {
+    RSI::FieldValue valuesA[256];
+    RSI::FieldValue valuesB[256];
+    uint64_t mismatches = 0;
+    for (const std::string& packet : packets) {
+        a.Parse(packet.data(), packet.size(), valuesA);
+        b.Parse(packet.data(), packet.size(), valuesB);
+        for (size_t i = 0; i < a.ColumnCount(); i++) {
+            for (size_t j = 0; j < b.ColumnCount(); j++) {
+                if (strcmp(a.ColumnName(i), b.ColumnName(j)) == 0 &&
+                    (valuesA[i].textLength != valuesB[j].textLength ||
+                     memcmp(&valuesA[i].integer, &valuesB[j].integer, 8) != 0)) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+#endif
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  RSIParserBench [options]   Time the RSI parser on one core\n"
+              << "  Options:\n"
+              << "    --packets <n>            Packets to parse (default 5000000)\n"
+              << "    --file <recording>       Parse the XML from a SystemTime|RelativeTime|XML file\n"
+              << "                             instead of synthetic packets\n";
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t total = 5000000;
+    std::string path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--packets" && i + 1 < argc) total = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--file" && i + 1 < argc) path = argv[++i];
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::vector<std::string> packets = path.empty() ? SyntheticPackets(2500) : RecordedPackets(path);
+    if (packets.empty() || total == 0) {
+        std::cout << "ERROR:NO_PACKETS" << std::endl;
+        return 1;
+    }
+
+    RSI::RSIParser parser(RSI::DefaultFields());
+    RSI::PinCurrentThread(RSI::LastCpu());
+
+    uint64_t allocationsBefore = allocations;
+    BenchResult generic = Time(parser, packets, total);
+    printf("OK:BENCH_COMPLETE\n");
+    printf("PACKETS:%llu\n", (unsigned long long)total);
+    Print("", parser, generic, total);
+
+#ifdef RSI_SCHEMA
+    // The generated parser must agree with the generic one on every field they share
+    RSI::SchemaParser schema;
+    BenchResult generated = Time(schema, packets, total);
+    Print("SCHEMA_", schema, generated, total);
+    printf("SCHEMA_MISMATCHES:%llu\n", (unsigned long long)Compare(parser, schema, packets));
+#endif
+
+    uint64_t allocationsDuring = allocations - allocationsBefore;
+    printf("ALLOCATIONS:%llu\n", (unsigned long long)allocationsDuring);
+    return allocationsDuring == 0 ? 0 : 1;
+}
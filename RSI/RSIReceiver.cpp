@@ -0,0 +1,668 @@
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RSICommon.h"
+#include "RSIHook.h"
+#include "RSIParser.h"
+
+#ifdef RSI_SCHEMA
+#include "RSISchema.h"
+#endif
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+// One received datagram as it waits for the writer
+struct RSIPacket {
+    int64_t timeNs;
+    uint32_t length;
+    bool kernelTime;
+    char data[RSI::MaxPacketBytes];
+};
+
+static std::atomic<bool> stopRequested(false);
+
+// Answers each packet on the socket thread: the echoed IPOC and the
+// correction from the hook, or zero without one.  The response time is
+// measured from the packet's receive stamp to the reply being sent.
+class RSIResponder {
+private:
+    enum { Ipoc = 0, RIst = 1, RSol = 7, AIPos = 13, Digin = 19, Delay = 20, FieldCount = 21 };
+
+    RSI::RSIParser parser;
+    RSI::FieldValue values[FieldCount];
+    std::string senType;
+    int64_t budgetNs;
+    void* library;
+    RSI_HOOK_CORRECT correct;
+    RSI_HOOK_CLOSE close;
+
+public:
+    RSI::LatencyHistogram responseTime;
+    uint64_t replies;
+    uint64_t overBudget;
+    uint64_t missingIpoc;
+    uint64_t hookErrors;
+    uint64_t sendErrors;
+
+    RSIResponder(const std::string& type, int budgetUs) :
+        parser(CycleFields()),
+        senType(type),
+        budgetNs((int64_t)budgetUs * 1000),
+        library(nullptr),
+        correct(nullptr),
+        close(nullptr),
+        replies(0),
+        overBudget(0),
+        missingIpoc(0),
+        hookErrors(0),
+        sendErrors(0)
+    { }
+
+    ~RSIResponder() {
+        if (close) {
+            close();
+        }
+#ifdef _WIN32
+        if (library) FreeLibrary((HMODULE)library);
+#else
+        if (library) dlclose(library);
+#endif
+    }
+
+    bool LoadHook(const std::string& path, const std::string& args) {
+#ifdef _WIN32
+        library = LoadLibraryA(path.c_str());
+#else
+        library = dlopen(path.c_str(), RTLD_NOW);
+#endif
+        if (!library) {
+            return false;
+        }
+        correct = (RSI_HOOK_CORRECT)Symbol("RSIHookCorrect");
+        RSI_HOOK_OPEN open = (RSI_HOOK_OPEN)Symbol("RSIHookOpen");
+        if (!correct || (open && open(args.c_str()) != 0)) {
+            correct = nullptr;
+            return false;
+        }
+        close = (RSI_HOOK_CLOSE)Symbol("RSIHookClose");
+        return true;
+    }
+
+    void Respond(RSI::UdpSocket& socket, const char* data, size_t length, const RSI::ReceiveSlot& slot) {
+        parser.Parse(data, length, values);
+        if (values[Ipoc].textLength == 0) {
+            missingIpoc++;
+            return;
+        }
+
+        RSI_CYCLE cycle;
+        cycle.ipoc = values[Ipoc].integer;
+        cycle.receiveTimeNs = RSI::HostClock::ToUnixNs(slot.timeNs);
+        for (int i = 0; i < 6; i++) {
+            cycle.rist[i] = values[RIst + i].number;
+            cycle.rsol[i] = values[RSol + i].number;
+            cycle.aipos[i] = values[AIPos + i].number;
+        }
+        cycle.digin = values[Digin].textLength ? values[Digin].integer : 0;
+        cycle.delay = values[Delay].textLength ? values[Delay].integer : 0;
+
+        RSI_CORRECTION correction = {};
+        if (correct) {
+            bool valid = correct(&cycle, &correction) == 0;
+            for (int i = 0; i < 6; i++) {
+                valid = valid && std::isfinite(correction.rkorr[i]);
+            }
+            if (!valid) {
+                hookErrors++;
+                correction = RSI_CORRECTION();
+            }
+        }
+
+        char reply[512];
+        int replyLength = snprintf(reply, sizeof(reply),
+            "<Sen Type=\"%s\"><RKorr X=\"%.4f\" Y=\"%.4f\" Z=\"%.4f\" A=\"%.4f\" B=\"%.4f\" C=\"%.4f\"/>"
+            "<IPOC>%lld</IPOC></Sen>",
+            senType.c_str(), correction.rkorr[0], correction.rkorr[1], correction.rkorr[2],
+            correction.rkorr[3], correction.rkorr[4], correction.rkorr[5], cycle.ipoc);
+        if (!socket.SendTo(reply, replyLength, (const sockaddr*)&slot.from, slot.fromLength)) {
+            sendErrors++;
+            return;
+        }
+
+        int64_t elapsed = RSI::HostClock::NowNs() - slot.timeNs;
+        responseTime.Add(elapsed);
+        replies++;
+        if (elapsed > budgetNs) {
+            overBudget++;
+        }
+    }
+
+    void PrintSummary() const {
+        printf("REPLIES:%llu\n", (unsigned long long)replies);
+        if (responseTime.Count() > 0) {
+            printf("RESPONSE_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   responseTime.PercentileUs(0.50), responseTime.PercentileUs(0.99),
+                   responseTime.MaxUs(), responseTime.MeanUs());
+        }
+        printf("OVER_BUDGET:%llu (budget %lld us)\n", (unsigned long long)overBudget,
+               (long long)(budgetNs / 1000));
+        printf("REPLY_ERRORS:no_ipoc=%llu,hook=%llu,send=%llu\n", (unsigned long long)missingIpoc,
+               (unsigned long long)hookErrors, (unsigned long long)sendErrors);
+    }
+
+private:
+    static std::vector<std::string> CycleFields() {
+        std::vector<std::string> fields = { "IPOC" };
+        const char* cartesian[] = { "X", "Y", "Z", "A", "B", "C" };
+        for (const char* name : cartesian) fields.push_back(std::string("RIst.") + name);
+        for (const char* name : cartesian) fields.push_back(std::string("RSol.") + name);
+        for (int axis = 1; axis <= 6; axis++) fields.push_back("AIPos.A" + std::to_string(axis));
+        fields.push_back("Digin");
+        fields.push_back("Delay.D");
+        return fields;
+    }
+
+    void* Symbol(const char* name) const {
+#ifdef _WIN32
+        return (void*)GetProcAddress((HMODULE)library, name);
+#else
+        return dlsym(library, name);
+#endif
+    }
+};
+
+static void HandleStopSignal(int) {
+    stopRequested = true;
+}
+
+// Receives RSI datagrams on a pinned thread and streams them to a file in
+// the SystemTime|RelativeTime|XML format of RSI.py's save_raw_data.  The
+// socket thread receives straight into a ring of packets that a writer
+// thread drains, so the socket loop never touches the disk.  With
+// --columns the writer also parses each packet into typed columns, and with
+// --respond the socket thread answers every packet before queueing it.  The
+// writer follows the IPOC counter for lost, repeated and late packets, and
+// fits the controller clock to the host clock to correct receive times.
+class RSIReceiver {
+private:
+    RSI::UdpSocket socket;
+    RSI::SpscRing<RSIPacket> ring;
+    std::string outputPath;
+    FILE* file;
+    const RSI::FieldParser* parser;
+    RSIResponder* responder;
+    RSI::RSIParser ipocParser;
+    RSI::FieldValue ipocValue;
+    RSI::IpocMonitor ipoc;
+    RSI::ClockFit clock;
+    std::atomic<double> liveDriftPpm;
+    std::atomic<uint64_t> noIpoc;
+    std::atomic<uint64_t> liveJitterP99;
+    RSI::ColumnWriter columns;
+    std::vector<RSI::FieldValue> values;
+    uint64_t parseErrors;
+    int cpu;
+    int64_t startNs;
+    std::atomic<bool> receiving;
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> dropped;
+    uint64_t truncated;
+    uint64_t batches;
+    uint64_t maxBatch;
+    uint64_t kernelStamped;
+    uint64_t socketErrors;
+    RSI::LatencyHistogram wakeDelay;     // Kernel stamp to the receive call returning
+    std::atomic<uint64_t> written;
+    uint64_t writeErrors;
+
+public:
+    RSIReceiver(size_t ringPackets, int periodMs) :
+        ring(ringPackets),
+        file(nullptr),
+        parser(nullptr),
+        responder(nullptr),
+        ipocParser({ "IPOC" }),
+        ipoc(periodMs),
+        liveDriftPpm(0.0),
+        noIpoc(0),
+        liveJitterP99(0),
+        parseErrors(0),
+        cpu(RSI::LastCpu()),
+        startNs(0),
+        receiving(false),
+        packets(0),
+        dropped(0),
+        truncated(0),
+        batches(0),
+        maxBatch(0),
+        kernelStamped(0),
+        socketErrors(0),
+        written(0),
+        writeErrors(0)
+    { }
+
+    ~RSIReceiver() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool Open(const std::string& ip, int port) {
+        return socket.Open(ip, port);
+    }
+
+    bool KernelTimestamps() const { return socket.KernelTimestamps(); }
+
+    void SetCpu(int value) { cpu = value; }
+
+    void SetResponder(RSIResponder* value) { responder = value; }
+
+    bool OpenOutput(const std::string& path) {
+        outputPath = path;
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        fputs("# SystemTime|RelativeTime|XML\n", file);
+        return true;
+    }
+
+    // Columnar output next to the raw file, .csv or binary by extension
+    bool OpenColumns(const std::string& path, const RSI::FieldParser& fields) {
+        parser = &fields;
+        values.resize(fields.ColumnCount());
+        return columns.Open(path, fields);
+    }
+
+    // Run until stopRequested, then drain the ring and close the file
+    void Record() {
+        startNs = RSI::HostClock::NowNs();
+        receiving = true;
+        std::thread receiver(&RSIReceiver::ReceiveLoop, this);
+        std::thread writer(&RSIReceiver::WriteLoop, this);
+
+        uint64_t lastReport = 0;
+        auto nextReport = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (!stopRequested) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (lastReport == 0 && packets > 0) {
+                std::cout << "First data point received! Collection started." << std::endl;
+                lastReport = 1;
+            }
+            if (std::chrono::steady_clock::now() >= nextReport) {
+                std::cout << "Collected " << packets << " data points... (missing " << ipoc.missing
+                          << ", duplicate " << ipoc.duplicates << ", reordered " << ipoc.reordered
+                          << ", late " << ipoc.late << ", jitter p99 " << liveJitterP99 << " us, drift "
+                          << liveDriftPpm << " ppm)" << std::endl;
+                nextReport += std::chrono::seconds(2);
+            }
+        }
+
+        receiving = false;
+        receiver.join();
+        writer.join();
+        ipoc.Finish();
+        fflush(file);
+        fclose(file);
+        file = nullptr;
+        columns.Close();
+    }
+
+    void PrintSummary() const {
+        printf("OK:RECORD_COMPLETE\n");
+        printf("PACKETS:%llu\n", (unsigned long long)packets.load());
+        printf("WRITTEN:%llu\n", (unsigned long long)written.load());
+        printf("DROPPED:%llu\n", (unsigned long long)dropped.load());
+        printf("TRUNCATED:%llu\n", (unsigned long long)truncated);
+        printf("BATCHES:calls=%llu,max=%llu\n", (unsigned long long)batches, (unsigned long long)maxBatch);
+        printf("KERNEL_TIMESTAMPS:%llu\n", (unsigned long long)kernelStamped);
+        if (wakeDelay.Count() > 0) {
+            printf("WAKE_DELAY_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   wakeDelay.PercentileUs(0.50), wakeDelay.PercentileUs(0.99),
+                   wakeDelay.MaxUs(), wakeDelay.MeanUs());
+        }
+        printf("IPOC:period=%lld,missing=%llu,gaps=%llu,max_gap=%llu,duplicate=%llu,reordered=%llu,late=%llu,no_ipoc=%llu\n",
+               (long long)ipoc.PeriodMs(), (unsigned long long)ipoc.missing.load(),
+               (unsigned long long)ipoc.gaps.load(), (unsigned long long)ipoc.maxGap,
+               (unsigned long long)ipoc.duplicates.load(), (unsigned long long)ipoc.reordered.load(),
+               (unsigned long long)ipoc.late.load(), (unsigned long long)noIpoc.load());
+        if (ipoc.jitter.Count() > 0) {
+            printf("JITTER_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   ipoc.jitter.PercentileUs(0.50), ipoc.jitter.PercentileUs(0.99),
+                   ipoc.jitter.MaxUs(), ipoc.jitter.MeanUs());
+        }
+        if (ipoc.lateness.Count() > 0) {
+            printf("LATENESS_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   ipoc.lateness.PercentileUs(0.50), ipoc.lateness.PercentileUs(0.99),
+                   ipoc.lateness.MaxUs(), ipoc.lateness.MeanUs());
+        }
+        printf("CLOCK:drift_ppm=%.3f,fits=%llu,outliers=%llu,resets=%llu\n", clock.DriftPpm(),
+               (unsigned long long)clock.fits, (unsigned long long)clock.outliers,
+               (unsigned long long)clock.resets);
+        if (clock.residual.Count() > 0) {
+            printf("CLOCK_RESIDUAL_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   clock.residual.PercentileUs(0.50), clock.residual.PercentileUs(0.99),
+                   clock.residual.MaxUs(), clock.residual.MeanUs());
+        }
+        if (responder) {
+            responder->PrintSummary();
+        }
+        printf("ERRORS:socket=%llu,write=%llu,parse=%llu\n", (unsigned long long)socketErrors,
+               (unsigned long long)writeErrors, (unsigned long long)parseErrors);
+        fflush(stdout);
+    }
+
+private:
+    // Socket thread: receive batches straight into the ring
+    void ReceiveLoop() {
+        RSI::ReceiveSlot slots[RSI::MaxBatch];
+        RSIPacket overflow[RSI::MaxBatch];
+
+        if (!RSI::PinCurrentThread(cpu)) {
+            std::cout << "Could not pin the socket thread to CPU " << cpu << std::endl;
+        }
+
+        while (receiving) {
+            size_t free = 0;
+            RSIPacket* target = ring.Reserve(&free);
+            bool full = (free == 0);
+            if (full) {
+                // Keep the socket drained, these are counted as dropped
+                target = overflow;
+                free = RSI::MaxBatch;
+            }
+            int count = free < (size_t)RSI::MaxBatch ? (int)free : RSI::MaxBatch;
+            for (int i = 0; i < count; i++) {
+                slots[i].data = target[i].data;
+                slots[i].capacity = sizeof(target[i].data);
+            }
+
+            int received = socket.ReceiveBatch(slots, count, 100);
+            if (received < 0) {
+                socketErrors++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (received == 0) {
+                continue;
+            }
+
+            // Replies first, they are on the robot's clock
+            if (responder) {
+                for (int i = 0; i < received; i++) {
+                    responder->Respond(socket, target[i].data, slots[i].length, slots[i]);
+                }
+            }
+
+            int64_t now = RSI::HostClock::NowNs();
+            for (int i = 0; i < received; i++) {
+                target[i].timeNs = slots[i].timeNs;
+                target[i].length = (uint32_t)slots[i].length;
+                target[i].kernelTime = slots[i].kernelTime;
+                if (slots[i].truncated) {
+                    truncated++;
+                }
+                if (slots[i].kernelTime) {
+                    kernelStamped++;
+                    wakeDelay.Add(now - slots[i].timeNs);
+                }
+            }
+            batches++;
+            if ((uint64_t)received > maxBatch) {
+                maxBatch = received;
+            }
+            if (full) {
+                dropped += received;
+            } else {
+                ring.Commit(received);
+            }
+            packets += received;
+        }
+    }
+
+    // Writer thread: format and write whatever the ring holds
+    void WriteLoop() {
+        std::string line;
+        auto lastFlush = std::chrono::steady_clock::now();
+        auto lastJitter = lastFlush;
+
+        while (true) {
+            bool draining = !receiving;
+            size_t count = 0;
+            RSIPacket* batch = ring.Peek(&count);
+            if (count == 0) {
+                if (draining) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                int64_t correctedNs = batch[i].timeNs;
+                if (ipocParser.Parse(batch[i].data, batch[i].length, &ipocValue) == 1) {
+                    ipoc.Add(ipocValue.integer, batch[i].timeNs);
+                    correctedNs = clock.Add(ipocValue.integer, batch[i].timeNs);
+                } else {
+                    noIpoc++;
+                }
+                FormatLine(batch[i], line);
+                if (fwrite(line.data(), 1, line.size(), file) != line.size()) {
+                    writeErrors++;
+                }
+                if (parser) {
+                    const RSIPacket& packet = batch[i];
+                    if (parser->Parse(packet.data, packet.length, values.data()) == 0) {
+                        parseErrors++;
+                    }
+                    if (!columns.WriteRow(packet.timeNs, correctedNs, startNs, values.data())) {
+                        writeErrors++;
+                    }
+                }
+            }
+            ring.Release(count);
+            written += count;
+
+            // Flush often enough that a crash loses little
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastFlush >= std::chrono::milliseconds(100)) {
+                fflush(file);
+                columns.Flush();
+                lastFlush = now;
+            }
+            if (now - lastJitter >= std::chrono::seconds(1)) {
+                liveJitterP99 = (uint64_t)ipoc.jitter.PercentileUs(0.99);
+                liveDriftPpm = clock.DriftPpm();
+                lastJitter = now;
+            }
+        }
+    }
+
+    void FormatLine(const RSIPacket& packet, std::string& line) const {
+        char systemTime[40];
+        char relativeTime[32];
+        RSI::HostClock::FormatLocal(packet.timeNs, systemTime, sizeof(systemTime));
+        snprintf(relativeTime, sizeof(relativeTime), "%.6f", (packet.timeNs - startNs) / 1e9);
+
+        line.assign(systemTime);
+        line += '|';
+        line += relativeTime;
+        line += '|';
+        for (uint32_t i = 0; i < packet.length; i++) {
+            if (packet.data[i] == '|') {
+                line += "&#124;";
+            } else {
+                line += packet.data[i];
+            }
+        }
+        line += '\n';
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  --check [options]          Check that the RSI port can be bound\n"
+              << "  --record <file> [options]  Record RSI packets to file until Ctrl+C or 'q'\n"
+              << "  Options:\n"
+              << "    --ip <address>           Local address to bind (default " << RSI::DefaultIp << ")\n"
+              << "    --port <port>            UDP port (default " << RSI::DefaultPort << ")\n"
+              << "    --cpu <n>                CPU for the socket thread, -1 = unpinned (default last)\n"
+              << "    --ring <packets>         Packets buffered ahead of the writer (default 4096)\n"
+              << "    --period <ms>            IPO cycle for loss and jitter checks, 4 or 12 (default learned)\n"
+              << "    --columns <file>         Also write parsed fields, CSV if <file> ends in .csv, else binary\n"
+              << "    --fields <list>          Comma-separated fields for --columns, e.g. RIst.X,RIst.Y,IPOC\n"
+#ifdef RSI_SCHEMA
+              << "                             (default the fields of the RSI configuration built in)\n"
+#else
+              << "                             (default RIst, RSol, AIPos, ASPos, Delay.D, Digin, IPOC)\n"
+#endif
+              << "    --respond                Answer each packet with its IPOC and an RKorr correction\n"
+              << "    --hook <library>         Correction hook for --respond, see RSIHook.h (default zero)\n"
+              << "    --hook-args <text>       Passed to the hook's RSIHookOpen\n"
+              << "    --sen-type <type>        Sen Type of the replies (default ImFree)\n"
+              << "    --budget-us <us>         Response time counted as over budget (default 1000)\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    std::string outputPath;
+    std::string ip = RSI::DefaultIp;
+    int port = RSI::DefaultPort;
+    int cpu = RSI::LastCpu();
+    size_t ringPackets = 4096;
+    int periodMs = 0;
+    std::string columnsPath;
+    std::vector<std::string> fields = RSI::DefaultFields();
+    bool fieldsGiven = false;
+    bool respond = false;
+    std::string hookPath;
+    std::string hookArgs;
+    std::string senType = "ImFree";
+    int budgetUs = 1000;
+    int first = 2;
+
+    if (command == "--record" && argc >= 3) {
+        outputPath = argv[2];
+        first = 3;
+    } else if (command != "--check") {
+        PrintUsage();
+        return 1;
+    }
+
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ip" && i + 1 < argc) ip = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) port = atoi(argv[++i]);
+        else if (arg == "--cpu" && i + 1 < argc) cpu = atoi(argv[++i]);
+        else if (arg == "--ring" && i + 1 < argc) ringPackets = (size_t)atol(argv[++i]);
+        else if (arg == "--period" && i + 1 < argc) periodMs = atoi(argv[++i]);
+        else if (arg == "--columns" && i + 1 < argc) columnsPath = argv[++i];
+        else if (arg == "--respond") respond = true;
+        else if (arg == "--hook" && i + 1 < argc) hookPath = argv[++i];
+        else if (arg == "--hook-args" && i + 1 < argc) hookArgs = argv[++i];
+        else if (arg == "--sen-type" && i + 1 < argc) senType = argv[++i];
+        else if (arg == "--budget-us" && i + 1 < argc) budgetUs = atoi(argv[++i]);
+        else if (arg == "--fields" && i + 1 < argc) {
+            fields.clear();
+            fieldsGiven = true;
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                if (comma > start) fields.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (fields.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    // The ring indexes with a mask
+    size_t capacity = 64;
+    while (capacity < ringPackets) {
+        capacity <<= 1;
+    }
+
+    RSIReceiver receiver(capacity, periodMs);
+    if (!receiver.Open(ip, port)) {
+        std::cout << "ERROR:BIND_FAILED " << ip << ":" << port << std::endl;
+        return 1;
+    }
+    std::cout << "Listening on " << ip << ":" << port
+              << (receiver.KernelTimestamps() ? " (kernel receive timestamps)" : " (user receive timestamps)")
+              << std::endl;
+
+    if (command == "--check") {
+        std::cout << "OK:PORT_AVAILABLE" << std::endl;
+        return 0;
+    }
+
+    if (!receiver.OpenOutput(outputPath)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << outputPath << std::endl;
+        return 1;
+    }
+    RSI::RSIParser parser(fields);
+    const RSI::FieldParser* columnParser = &parser;
+#ifdef RSI_SCHEMA
+    RSI::SchemaParser schemaParser;
+    if (!fieldsGiven) {
+        columnParser = &schemaParser;
+    }
+#endif
+    if (!columnsPath.empty() && !receiver.OpenColumns(columnsPath, *columnParser)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << columnsPath << std::endl;
+        return 1;
+    }
+    receiver.SetCpu(cpu);
+
+    RSIResponder responder(senType, budgetUs);
+    if (respond) {
+        if (!hookPath.empty() && !responder.LoadHook(hookPath, hookArgs)) {
+            std::cout << "ERROR:HOOK_LOAD_FAILED " << hookPath << std::endl;
+            return 1;
+        }
+        receiver.SetResponder(&responder);
+    }
+
+    // Ctrl+C, or 'q' when driven by RSI.py; closed input is ignored so the
+    // receiver also runs with no console
+    std::signal(SIGINT, HandleStopSignal);
+    std::signal(SIGTERM, HandleStopSignal);
+    std::thread([]() {
+        std::string input;
+        while (std::getline(std::cin, input)) {
+            if (input == "q" || input == "Q") {
+                stopRequested = true;
+                return;
+            }
+        }
+    }).detach();
+
+    std::cout << "OK:RECORDING_STARTED" << std::endl;
+    std::cout << "Waiting for first data point..." << std::endl;
+    receiver.Record();
+    receiver.PrintSummary();
+    return 0;
+}
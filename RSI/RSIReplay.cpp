@@ -0,0 +1,223 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "RSICommon.h"
+
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Resends a recording made by save_raw_data or RSIReceiver (lines of
+// SystemTime|RelativeTime|XML) to a local port at the recorded times, or
+// faster with --speed, so parsers and recorders can be run against real
+// robot traffic without the robot.
+class RSIReplay {
+private:
+    struct Packet {
+        double relativeTime;
+        std::string xml;
+    };
+
+    RSI::UdpSocket socket;
+    sockaddr_in target;
+    std::vector<Packet> packets;
+    uint64_t skippedLines;
+    RSI::LatencyHistogram sendLateness;   // Send time past the scheduled time
+    uint64_t sent;
+    uint64_t sendErrors;
+    double elapsedSeconds;
+
+public:
+    RSIReplay() :
+        target(),
+        skippedLines(0),
+        sent(0),
+        sendErrors(0),
+        elapsedSeconds(0)
+    { }
+
+    bool Open(const std::string& ip, int port) {
+        target.sin_family = AF_INET;
+        target.sin_port = htons((unsigned short)port);
+        return inet_pton(AF_INET, ip.c_str(), &target.sin_addr) == 1 && socket.Open("0.0.0.0", 0);
+    }
+
+    // Read the whole recording up front so the send loop never touches the disk
+    bool Load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            size_t first = line.find('|');
+            size_t second = first == std::string::npos ? first : line.find('|', first + 1);
+            if (second == std::string::npos || second + 1 >= line.size()) {
+                skippedLines++;
+                continue;
+            }
+            char* end;
+            double relative = strtod(line.c_str() + first + 1, &end);
+            if (end != line.c_str() + second) {
+                skippedLines++;
+                continue;
+            }
+            packets.push_back(Packet{ relative, Unescape(line.substr(second + 1)) });
+        }
+        return true;
+    }
+
+    size_t PacketCount() const { return packets.size(); }
+    double Duration() const { return packets.empty() ? 0.0 : packets.back().relativeTime - packets.front().relativeTime; }
+
+    // speed 0 sends back to back; otherwise recorded gaps are divided by speed
+    void Run(double speed, int loops) {
+        using Clock = std::chrono::steady_clock;
+
+        RSI::PinCurrentThread(-1);
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        auto start = Clock::now() + std::chrono::milliseconds(10);
+        auto loopStart = start;
+        double loopLength = packets.size() > 1 ? Duration() + (Duration() / (packets.size() - 1)) : 0.0;
+
+        for (int loop = 0; loop < loops; loop++) {
+            for (const Packet& packet : packets) {
+                auto deadline = loopStart;
+                if (speed > 0) {
+                    deadline += std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>((packet.relativeTime - packets.front().relativeTime) / speed));
+                    std::this_thread::sleep_until(deadline - std::chrono::milliseconds(1));
+                    while (Clock::now() < deadline) { }
+                }
+
+                auto sendTime = Clock::now();
+                if (socket.SendTo(packet.xml.data(), packet.xml.size(), (const sockaddr*)&target, sizeof(target))) {
+                    sent++;
+                } else {
+                    sendErrors++;
+                }
+                if (speed > 0) {
+                    sendLateness.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(sendTime - deadline).count());
+                }
+            }
+            if (speed > 0) {
+                loopStart += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(loopLength / speed));
+            } else {
+                loopStart = Clock::now();
+            }
+        }
+        elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    void PrintSummary() const {
+        printf("OK:REPLAY_COMPLETE\n");
+        printf("SENT:%llu\n", (unsigned long long)sent);
+        printf("SEND_ERRORS:%llu\n", (unsigned long long)sendErrors);
+        printf("SKIPPED_LINES:%llu\n", (unsigned long long)skippedLines);
+        printf("ELAPSED_S:%.3f\n", elapsedSeconds);
+        printf("PACKETS_PER_S:%.0f\n", elapsedSeconds > 0 ? sent / elapsedSeconds : 0.0);
+        if (sendLateness.Count() > 0) {
+            printf("SEND_LATE_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   sendLateness.PercentileUs(0.50), sendLateness.PercentileUs(0.99),
+                   sendLateness.MaxUs(), sendLateness.MeanUs());
+        }
+        fflush(stdout);
+    }
+
+private:
+    // save_raw_data writes '|' inside the XML as &#124;
+    static std::string Unescape(const std::string& xml) {
+        std::string result;
+        result.reserve(xml.size());
+        for (size_t i = 0; i < xml.size(); i++) {
+            if (xml.compare(i, 6, "&#124;") == 0) {
+                result += '|';
+                i += 5;
+            } else {
+                result += xml[i];
+            }
+        }
+        return result;
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  --replay <file> [options]  Resend a SystemTime|RelativeTime|XML recording\n"
+              << "  Options:\n"
+              << "    --ip <address>           Receiver address (default 127.0.0.1)\n"
+              << "    --port <port>            Receiver UDP port (default " << RSI::DefaultPort << ")\n"
+              << "    --speed <x>              Multiple of the recorded rate, 0 = as fast as possible (default 1)\n"
+              << "    --loop <n>               Send the recording n times (default 1)\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || std::string(argv[1]) != "--replay") {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string path = argv[2];
+    std::string ip = "127.0.0.1";
+    int port = RSI::DefaultPort;
+    double speed = 1.0;
+    int loops = 1;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ip" && i + 1 < argc) ip = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) port = atoi(argv[++i]);
+        else if (arg == "--speed" && i + 1 < argc) speed = atof(argv[++i]);
+        else if (arg == "--loop" && i + 1 < argc) loops = atoi(argv[++i]);
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (speed < 0 || loops < 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    RSIReplay replay;
+    if (!replay.Load(path)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << path << std::endl;
+        return 1;
+    }
+    if (replay.PacketCount() == 0) {
+        std::cout << "ERROR:NO_PACKETS " << path << std::endl;
+        return 1;
+    }
+    if (!replay.Open(ip, port)) {
+        std::cout << "ERROR:SOCKET_FAILED" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Replaying " << replay.PacketCount() << " packets (" << replay.Duration() << " s) to "
+              << ip << ":" << port;
+    if (speed > 0) {
+        std::cout << " at " << speed << "x" << std::endl;
+    } else {
+        std::cout << " back to back" << std::endl;
+    }
+    replay.Run(speed, loops);
+    replay.PrintSummary();
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Generates RSISchema.h from the robot's RSI Visual Ethernet configuration
+// (the XML the ETHERNET object points to).  The <SEND> elements are the
+// fields the robot puts in every packet; the generated header has a frame
+// struct with one column per field and a parser that visits exactly those
+// elements and attributes in that order, with no tables or maps at run time.
+//
+//   RSISchemaGen RSI_EthernetConfig.xml RSISchema.h
+
+namespace {
+
+enum class FieldKind { Float64, Int64 };
+
+struct Field {
+    std::string element;
+    std::string attribute;       // Empty for the element text
+    FieldKind kind;
+};
+
+struct Element {
+    std::string name;
+    std::vector<Field> fields;
+};
+
+// Attributes the robot sends for each DEF_ tag
+struct Predefined {
+    const char* tag;
+    const char* element;
+    const char* attributes[7];
+    FieldKind kind;
+};
+
+const Predefined predefined[] = {
+    { "DEF_RIst", "RIst", { "X", "Y", "Z", "A", "B", "C", nullptr }, FieldKind::Float64 },
+    { "DEF_RSol", "RSol", { "X", "Y", "Z", "A", "B", "C", nullptr }, FieldKind::Float64 },
+    { "DEF_AIPos", "AIPos", { "A1", "A2", "A3", "A4", "A5", "A6", nullptr }, FieldKind::Float64 },
+    { "DEF_ASPos", "ASPos", { "A1", "A2", "A3", "A4", "A5", "A6", nullptr }, FieldKind::Float64 },
+    { "DEF_EIPos", "EIPos", { "E1", "E2", "E3", "E4", "E5", "E6", nullptr }, FieldKind::Float64 },
+    { "DEF_ESPos", "ESPos", { "E1", "E2", "E3", "E4", "E5", "E6", nullptr }, FieldKind::Float64 },
+    { "DEF_MACur", "MACur", { "A1", "A2", "A3", "A4", "A5", "A6", nullptr }, FieldKind::Float64 },
+    { "DEF_MECur", "MECur", { "E1", "E2", "E3", "E4", "E5", "E6", nullptr }, FieldKind::Float64 },
+    { "DEF_Delay", "Delay", { "D", nullptr }, FieldKind::Int64 },
+};
+
+// Value of name="..." inside one start tag, empty if absent
+std::string AttributeValue(const std::string& tag, const std::string& name) {
+    size_t at = 0;
+    while ((at = tag.find(name, at)) != std::string::npos) {
+        size_t after = at + name.size();
+        bool boundary = at > 0 && (tag[at - 1] == ' ' || tag[at - 1] == '\t' || tag[at - 1] == '\n' || tag[at - 1] == '\r');
+        if (boundary && after < tag.size() && tag[after] == '=') {
+            size_t quote = tag.find_first_of("\"'", after);
+            if (quote == std::string::npos) {
+                return "";
+            }
+            size_t close = tag.find(tag[quote], quote + 1);
+            return close == std::string::npos ? "" : tag.substr(quote + 1, close - quote - 1);
+        }
+        at = after;
+    }
+    return "";
+}
+
+void AddField(std::vector<Element>& elements, const Field& field) {
+    for (Element& element : elements) {
+        if (element.name == field.element) {
+            element.fields.push_back(field);
+            return;
+        }
+    }
+    elements.push_back(Element{ field.element, { field } });
+}
+
+// Fields of the <SEND> section in the order the robot sends them
+bool ReadConfig(const std::string& xml, std::vector<Element>& elements, std::string& error) {
+    size_t send = xml.find("<SEND");
+    size_t sendEnd = xml.find("</SEND>", send);
+    if (send == std::string::npos || sendEnd == std::string::npos) {
+        error = "no <SEND> section";
+        return false;
+    }
+
+    size_t at = send;
+    while ((at = xml.find("<ELEMENT", at)) != std::string::npos && at < sendEnd) {
+        size_t close = xml.find('>', at);
+        std::string tag = xml.substr(at, close - at);
+        at = close;
+        if (tag.compare(0, 9, "<ELEMENTS") == 0) {
+            continue;
+        }
+
+        std::string name = AttributeValue(tag, "TAG");
+        std::string type = AttributeValue(tag, "TYPE");
+        if (name.empty()) {
+            error = "ELEMENT without TAG: " + tag;
+            return false;
+        }
+
+        if (name.compare(0, 4, "DEF_") == 0) {
+            const Predefined* match = nullptr;
+            for (const Predefined& entry : predefined) {
+                if (name == entry.tag) {
+                    match = &entry;
+                }
+            }
+            if (!match) {
+                std::cerr << "Skipping " << name << ", its attributes are not known" << std::endl;
+                continue;
+            }
+            for (int i = 0; match->attributes[i]; i++) {
+                AddField(elements, Field{ match->element, match->attributes[i], match->kind });
+            }
+            continue;
+        }
+
+        if (type == "STRING") {
+            std::cerr << "Skipping " << name << ", strings are not parsed into columns" << std::endl;
+            continue;
+        }
+        FieldKind kind = (type == "DOUBLE") ? FieldKind::Float64 : FieldKind::Int64;
+        size_t dot = name.find('.');
+        if (dot == std::string::npos) {
+            AddField(elements, Field{ name, "", kind });
+        } else {
+            AddField(elements, Field{ name.substr(0, dot), name.substr(dot + 1), kind });
+        }
+    }
+
+    // The robot adds the IPOC to every packet
+    AddField(elements, Field{ "IPOC", "", FieldKind::Int64 });
+    return true;
+}
+
+std::string ColumnName(const Field& field) {
+    return field.attribute.empty() ? field.element : field.element + "." + field.attribute;
+}
+
+std::string Identifier(const Field& field) {
+    std::string name = field.attribute.empty() ? field.element : field.element + "_" + field.attribute;
+    for (char& c : name) {
+        if (!isalnum((unsigned char)c)) {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+const char* KindName(FieldKind kind) {
+    return kind == FieldKind::Float64 ? "ColumnType::Float64" : "ColumnType::Int64";
+}
+
+std::string Generate(const std::vector<Element>& elements, const std::string& source) {
+    std::vector<Field> fields;
+    for (const Element& element : elements) {
+        fields.insert(fields.end(), element.fields.begin(), element.fields.end());
+    }
+
+    std::ostringstream out;
+    out << "// Generated by RSISchemaGen from " << source << ".\n"
+        << "// Do not edit; regenerate when the RSI Visual configuration changes.\n"
+        << "#pragma once\n\n"
+        << "#include \"RSIParser.h\"\n\n"
+        << "namespace RSI {\n\n"
+        << "// One packet of the configured fields\n"
+        << "struct RSIFrame {\n"
+        << "    enum Column {\n";
+    for (size_t i = 0; i < fields.size(); i++) {
+        out << "        " << Identifier(fields[i]) << " = " << i << ",\n";
+    }
+    out << "        ColumnCount = " << fields.size() << "\n"
+        << "    };\n\n"
+        << "    FieldValue values[ColumnCount];\n\n"
+        << "    bool Has(Column column) const { return values[column].textLength != 0; }\n"
+        << "    double Number(Column column) const { return values[column].number; }\n"
+        << "    int64_t Integer(Column column) const { return values[column].integer; }\n"
+        << "};\n\n";
+
+    out << "inline int ParseRSIFrame(const char* data, size_t length, FieldValue* values) {\n"
+        << "    SchemaScanner scan(data, length);\n"
+        << "    int found = 0;\n";
+    size_t column = 0;
+    for (const Element& element : elements) {
+        std::string open = "<" + element.name;
+        out << "\n    scan.Element(\"" << open << "\", " << open.size() << ");\n";
+        for (const Field& field : element.fields) {
+            if (field.attribute.empty()) {
+                out << "    found += scan.Text(" << KindName(field.kind) << ", values[" << column << "]);\n";
+            } else {
+                std::string name = field.attribute + "=";
+                out << "    found += scan.Attribute(\"" << name << "\", " << name.size() << ", "
+                    << KindName(field.kind) << ", values[" << column << "]);\n";
+            }
+            column++;
+        }
+    }
+    out << "    return found;\n"
+        << "}\n\n"
+        << "inline int ParseRSIFrame(const char* data, size_t length, RSIFrame& frame) {\n"
+        << "    return ParseRSIFrame(data, length, frame.values);\n"
+        << "}\n\n";
+
+    out << "// The generated parser behind the FieldParser interface, for ColumnWriter\n"
+        << "class SchemaParser : public FieldParser {\n"
+        << "public:\n"
+        << "    size_t ColumnCount() const override { return RSIFrame::ColumnCount; }\n\n"
+        << "    const char* ColumnName(size_t column) const override {\n"
+        << "        static const char* const names[] = {\n";
+    for (const Field& field : fields) {
+        out << "            \"" << ColumnName(field) << "\",\n";
+    }
+    out << "        };\n"
+        << "        return names[column];\n"
+        << "    }\n\n"
+        << "    ColumnType Type(size_t column) const override {\n"
+        << "        static const ColumnType types[] = {\n";
+    for (const Field& field : fields) {
+        out << "            " << KindName(field.kind) << ",\n";
+    }
+    out << "        };\n"
+        << "        return types[column];\n"
+        << "    }\n\n"
+        << "    int Parse(const char* data, size_t length, FieldValue* values) const override {\n"
+        << "        return ParseRSIFrame(data, length, values);\n"
+        << "    }\n"
+        << "};\n\n"
+        << "}  // namespace RSI\n";
+    return out.str();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cout << "Usage: RSISchemaGen <RSI Ethernet config.xml> <RSISchema.h>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream xml;
+    xml << input.rdbuf();
+
+    std::vector<Element> elements;
+    std::string error;
+    if (!ReadConfig(xml.str(), elements, error)) {
+        std::cout << "ERROR:BAD_CONFIG " << error << std::endl;
+        return 1;
+    }
+
+    std::string source = argv[1];
+    size_t slash = source.find_last_of("/\\");
+    std::string header = Generate(elements, slash == std::string::npos ? source : source.substr(slash + 1));
+
+    // Leave the file alone when nothing changed, so it does not trigger rebuilds
+    std::ifstream existing(argv[2], std::ios::binary);
+    std::stringstream old;
+    old << existing.rdbuf();
+    if (existing && old.str() == header) {
+        return 0;
+    }
+    std::ofstream output(argv[2], std::ios::binary);
+    if (!output || !(output << header)) {
+        std::cout << "ERROR:FILE_WRITE_FAILED " << argv[2] << std::endl;
+        return 1;
+    }
+    size_t count = 0;
+    for (const Element& element : elements) {
+        count += element.fields.size();
+    }
+    std::cout << "OK:SCHEMA_GENERATED " << count << " fields" << std::endl;
+    return 0;
+}
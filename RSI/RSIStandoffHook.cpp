@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "RSIHook.h"
+#include "LEMBOXLIB.H"
+
+// Torch standoff correction from the LEM Box arc voltage, as a hook for
+// RSIReceiver --respond.  Arc voltage rises with arc length, so each cycle
+// the torch moves along Z by gain * (target - voltage), limited to
+// max-step.  The hook runs the LEM Box itself through LEMBOXLIB, so
+// LEMBOX.exe must not be running; give file= to record its data as usual.
+//
+//   RSIReceiver --record robot.txt --respond --hook RSIStandoffHook.dll
+//       --hook-args "target=24.5,gain=0.02,max-step=0.05,file=lembox.csv"
+//
+// Other key=value pairs go to LemBoxConfigure (rate=, simulate=1, ...).
+//
+// The board hands over samples a 4000-sample buffer at a time, so the
+// newest sample is normally up to one buffer old.  When no buffer has
+// arrived for two buffers' time (the board stalled or stopped) the samples
+// are stale: the hook sends no correction and counts the cycle.
+
+namespace {
+
+struct StandoffConfig {
+    double targetVolts = 24.0;
+    double gain = 0.01;               // mm per volt of error per cycle; negative flips Z
+    double maxStep = 0.05;            // mm per cycle
+    double deadband = 0.2;            // volts
+    double minCurrent = 20.0;         // amps, below this the arc is off
+    double windowMs = 2.0;            // samples averaged per cycle
+    std::string dataFile;
+};
+
+const size_t MaxWindow = 4096;
+const double BufferSamples = 4000;    // LEMBOXLIB's SAMPLES_PER_BUFFER
+
+StandoffConfig config;
+LEMBOX_SAMPLE window[MaxWindow];
+size_t windowSamples = 40;
+std::chrono::steady_clock::duration staleAfter = std::chrono::milliseconds(400);
+unsigned long latestHead = 0;
+std::chrono::steady_clock::time_point headMoved;
+unsigned long long cycles = 0;
+unsigned long long arcCycles = 0;
+unsigned long long staleCycles = 0;
+double voltageSum = 0;
+double correctionSum = 0;
+
+bool ApplyOption(const std::string& key, const std::string& value) {
+    double number = atof(value.c_str());
+    if (key == "target") config.targetVolts = number;
+    else if (key == "gain") config.gain = number;
+    else if (key == "max-step") config.maxStep = number;
+    else if (key == "deadband") config.deadband = number;
+    else if (key == "min-current") config.minCurrent = number;
+    else if (key == "window") config.windowMs = number;
+    else if (key == "file") config.dataFile = value;
+    else {
+        int error = LemBoxConfigure(key.c_str(), value.c_str());
+        if (error != LEMBOX_OK) {
+            printf("Standoff hook: %s=%s: %s\n", key.c_str(), value.c_str(), LemBoxErrorName(error));
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+extern "C" RSI_HOOK_API int RSIHookOpen(const char* args) {
+    std::string text = args ? args : "";
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        std::string option = text.substr(start, comma - start);
+        size_t equals = option.find('=');
+        if (!option.empty() &&
+            !ApplyOption(option.substr(0, equals), equals == std::string::npos ? "1" : option.substr(equals + 1))) {
+            return 1;
+        }
+        start = comma + 1;
+    }
+
+    int error = LemBoxOpen();
+    if (error == LEMBOX_OK) {
+        error = LemBoxStart(config.dataFile.empty() ? NULL : config.dataFile.c_str());
+    }
+    if (error != LEMBOX_OK) {
+        printf("Standoff hook: ERROR:%s\n", LemBoxErrorName(error));
+        LemBoxClose();
+        return 1;
+    }
+
+    LEMBOX_STATS stats;
+    LemBoxGetStats(&stats);
+    windowSamples = (size_t)(config.windowMs * stats.sampleRate / 1000.0);
+    if (windowSamples < 1) windowSamples = 1;
+    if (windowSamples > MaxWindow) windowSamples = MaxWindow;
+    staleAfter = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(2 * BufferSamples / stats.sampleRate));
+    latestHead = LemBoxLatestHead();
+    headMoved = std::chrono::steady_clock::now();
+    printf("Standoff hook: target %.2f V, gain %.4f mm/V, max step %.3f mm, %zu samples per cycle\n",
+           config.targetVolts, config.gain, config.maxStep, windowSamples);
+    return 0;
+}
+
+extern "C" RSI_HOOK_API int RSIHookCorrect(const RSI_CYCLE* cycle, RSI_CORRECTION* correction) {
+    (void)cycle;
+    cycles++;
+
+    auto now = std::chrono::steady_clock::now();
+    unsigned long head = LemBoxLatestHead();
+    if (head != latestHead) {
+        latestHead = head;
+        headMoved = now;
+    } else if (now - headMoved > staleAfter) {
+        staleCycles++;
+        return 0;
+    }
+
+    size_t count = LemBoxReadLatest(window, windowSamples);
+    if (count == 0) {
+        return 0;
+    }
+    long long voltageUv = 0;
+    long long currentUv = 0;
+    for (size_t i = 0; i < count; i++) {
+        voltageUv += window[i].voltageUv;
+        currentUv += window[i].currentUv;
+    }
+    // The LEM Box divides voltage by 10 and current by 100
+    double volts = voltageUv * 1e-5 / count;
+    double amps = currentUv * 1e-4 / count;
+    if (amps < config.minCurrent) {
+        return 0;
+    }
+
+    arcCycles++;
+    voltageSum += volts;
+    double error = config.targetVolts - volts;
+    if (error > -config.deadband && error < config.deadband) {
+        return 0;
+    }
+    double step = config.gain * error;
+    if (step > config.maxStep) step = config.maxStep;
+    if (step < -config.maxStep) step = -config.maxStep;
+    correction->rkorr[2] = step;
+    correctionSum += step;
+    return 0;
+}
+
+extern "C" RSI_HOOK_API void RSIHookClose(void) {
+    LemBoxStop();
+    LemBoxClose();
+    printf("STANDOFF:cycles=%llu,arc=%llu,stale=%llu,mean_v=%.2f,z_total=%.4f\n", cycles, arcCycles,
+           staleCycles, arcCycles ? voltageSum / arcCycles : 0.0, correctionSum);
+    fflush(stdout);
+}
@@ -0,0 +1,343 @@
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "RSICommon.h"
+#include "RSIParser.h"
+
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Stands in for the robot controller: sends KUKA RSI packets to a local
+// port once per IPO cycle, with the IPOC counter, a weaving TCP path and
+// axis positions, so the receiver can be tested without the robot.  With
+// --check-replies it also checks the answers as the controller would: the
+// echoed IPOC, and that each reply arrives within the cycle.  The --drop,
+// --duplicate and --swap faults exercise the receiver's IPOC checks, and
+// --clock-ppm runs the simulated controller clock off the host's to test
+// the clock fit.
+class RobotSim {
+private:
+    RSI::UdpSocket socket;
+    sockaddr_in target;
+    int periodMs;
+    uint64_t ipoc;
+    double clockPpm;                      // Controller clock rate error
+    RSI::LatencyHistogram sendLateness;   // Send time past the cycle deadline
+    uint64_t sent;
+    uint64_t sendErrors;
+
+    // Injected faults, every Nth cycle (0 = off)
+    uint64_t dropEvery;
+    uint64_t duplicateEvery;
+    uint64_t swapEvery;
+    uint64_t dropped;
+    uint64_t duplicated;
+    uint64_t swapped;
+
+    // Reply checking
+    bool checkReplies;
+    uint64_t firstIpoc;
+    uint64_t cycles;
+    std::unique_ptr<std::atomic<int64_t>[]> sendNs;   // Per cycle, 0 until sent
+    std::unique_ptr<bool[]> answered;
+    std::atomic<bool> listening;
+    RSI::LatencyHistogram roundTrip;    // Send to the reply arriving
+    uint64_t replies;
+    uint64_t lateReplies;
+    uint64_t duplicateReplies;
+    uint64_t unknownIpoc;
+    uint64_t badReplies;
+    double correctionSum[6];
+
+public:
+    RobotSim(int period, bool check) :
+        target(),
+        periodMs(period),
+        ipoc(4208050),
+        clockPpm(0.0),
+        sent(0),
+        sendErrors(0),
+        dropEvery(0),
+        duplicateEvery(0),
+        swapEvery(0),
+        dropped(0),
+        duplicated(0),
+        swapped(0),
+        checkReplies(check),
+        firstIpoc(4208050),
+        cycles(0),
+        listening(false),
+        replies(0),
+        lateReplies(0),
+        duplicateReplies(0),
+        unknownIpoc(0),
+        badReplies(0),
+        correctionSum()
+    { }
+
+    void SetClockPpm(double ppm) { clockPpm = ppm; }
+
+    void SetFaults(uint64_t drop, uint64_t duplicate, uint64_t swap) {
+        dropEvery = drop;
+        duplicateEvery = duplicate;
+        swapEvery = swap;
+    }
+
+    bool Open(const std::string& ip, int port) {
+        target.sin_family = AF_INET;
+        target.sin_port = htons((unsigned short)port);
+        return inet_pton(AF_INET, ip.c_str(), &target.sin_addr) == 1 && socket.Open("0.0.0.0", 0);
+    }
+
+    // Send count packets, one per period, spinning out the last
+    // millisecond before each deadline
+    void Run(uint64_t count) {
+        using Clock = std::chrono::steady_clock;
+        const auto period = std::chrono::milliseconds(periodMs);
+        // A fast controller clock finishes its IPO cycles early in host time
+        const auto cycle = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(periodMs / (1.0 + clockPpm * 1e-6)));
+        std::string packet;
+        std::string held;                 // Swapped packet, sent after the next one
+        uint64_t heldCycle = 0;
+        std::thread replyThread;
+
+        cycles = count;
+        if (checkReplies) {
+            sendNs.reset(new std::atomic<int64_t>[count]());
+            answered.reset(new bool[count]());
+            listening = true;
+            replyThread = std::thread(&RobotSim::ReplyLoop, this);
+        }
+
+        RSI::PinCurrentThread(-1);
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        auto deadline = Clock::now() + period;
+        for (uint64_t i = 0; i < count; i++) {
+            BuildPacket(i, packet);
+            std::this_thread::sleep_until(deadline - std::chrono::milliseconds(1));
+            while (Clock::now() < deadline) { }
+
+            auto sendTime = Clock::now();
+            bool drop = Every(dropEvery, i);
+            bool hold = !drop && Every(swapEvery, i) && i + 1 < count;
+            if (drop) {
+                dropped++;
+            } else if (hold) {
+                swapped++;
+            } else {
+                Send(packet, i);
+                if (Every(duplicateEvery, i)) {
+                    duplicated++;
+                    Send(packet, i);
+                }
+            }
+            if (!held.empty()) {
+                Send(held, heldCycle);
+                held.clear();
+            }
+            if (hold) {
+                held = packet;
+                heldCycle = i;
+            }
+            sendLateness.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(sendTime - deadline).count());
+            deadline += cycle;
+            ipoc += periodMs;
+        }
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+
+        if (checkReplies) {
+            // Give the last reply a cycle to arrive
+            std::this_thread::sleep_for(period + std::chrono::milliseconds(100));
+            listening = false;
+            replyThread.join();
+        }
+    }
+
+    void PrintSummary() const {
+        printf("OK:SIM_COMPLETE\n");
+        printf("SENT:%llu\n", (unsigned long long)sent);
+        printf("SEND_ERRORS:%llu\n", (unsigned long long)sendErrors);
+        if (dropEvery || duplicateEvery || swapEvery) {
+            printf("FAULTS:dropped=%llu,duplicated=%llu,swapped=%llu\n", (unsigned long long)dropped,
+                   (unsigned long long)duplicated, (unsigned long long)swapped);
+        }
+        printf("SEND_LATE_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+               sendLateness.PercentileUs(0.50), sendLateness.PercentileUs(0.99),
+               sendLateness.MaxUs(), sendLateness.MeanUs());
+        if (checkReplies) {
+            printf("REPLIES:%llu\n", (unsigned long long)replies);
+            printf("REPLY_MISSING:%llu\n", (unsigned long long)(sent - replies));
+            printf("REPLY_LATE:%llu\n", (unsigned long long)lateReplies);
+            printf("REPLY_ERRORS:unknown_ipoc=%llu,duplicate=%llu,bad=%llu\n",
+                   (unsigned long long)unknownIpoc, (unsigned long long)duplicateReplies,
+                   (unsigned long long)badReplies);
+            if (roundTrip.Count() > 0) {
+                printf("REPLY_RTT_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                       roundTrip.PercentileUs(0.50), roundTrip.PercentileUs(0.99),
+                       roundTrip.MaxUs(), roundTrip.MeanUs());
+            }
+            printf("RKORR_SUM:X=%.4f,Y=%.4f,Z=%.4f,A=%.4f,B=%.4f,C=%.4f\n",
+                   correctionSum[0], correctionSum[1], correctionSum[2],
+                   correctionSum[3], correctionSum[4], correctionSum[5]);
+        }
+        fflush(stdout);
+    }
+
+private:
+    static bool Every(uint64_t every, uint64_t cycle) {
+        return every != 0 && (cycle + 1) % every == 0;
+    }
+
+    // SENT counts cycles, so a duplicate is only sent, timed and answered once
+    void Send(const std::string& packet, uint64_t cycle) {
+        bool first = !checkReplies || sendNs[cycle] == 0;
+        if (checkReplies && first) {
+            sendNs[cycle] = RSI::HostClock::NowNs();
+        }
+        if (!socket.SendTo(packet.data(), packet.size(), (const sockaddr*)&target, sizeof(target))) {
+            sendErrors++;
+        } else if (first) {
+            sent++;
+        }
+    }
+
+    // Match replies to the cycle whose IPOC they echo.  A reply later than
+    // one period would have been counted as late by the controller.
+    void ReplyLoop() {
+        RSI::RSIParser parser({ "IPOC", "RKorr.X", "RKorr.Y", "RKorr.Z", "RKorr.A", "RKorr.B", "RKorr.C" });
+        RSI::FieldValue values[7];
+        RSI::ReceiveSlot slots[8];
+        char buffers[8][RSI::MaxPacketBytes];
+        for (int i = 0; i < 8; i++) {
+            slots[i].data = buffers[i];
+            slots[i].capacity = sizeof(buffers[i]);
+        }
+
+        while (listening) {
+            int received = socket.ReceiveBatch(slots, 8, 50);
+            for (int i = 0; i < received; i++) {
+                if (parser.Parse(slots[i].data, slots[i].length, values) != 7) {
+                    badReplies++;
+                    continue;
+                }
+                int64_t offset = values[0].integer - (int64_t)firstIpoc;
+                uint64_t cycle = (uint64_t)(offset / periodMs);
+                if (offset < 0 || offset % periodMs != 0 || cycle >= cycles || sendNs[cycle] == 0) {
+                    unknownIpoc++;
+                    continue;
+                }
+                if (answered[cycle]) {
+                    duplicateReplies++;
+                    continue;
+                }
+                answered[cycle] = true;
+                replies++;
+                int64_t rtt = slots[i].timeNs - sendNs[cycle];
+                roundTrip.Add(rtt);
+                if (rtt > (int64_t)periodMs * 1000000) {
+                    lateReplies++;
+                }
+                for (int axis = 0; axis < 6; axis++) {
+                    correctionSum[axis] += values[1 + axis].number;
+                }
+            }
+        }
+    }
+
+    // 10 mm/s travel along X with a 2 mm, 2 Hz weave in Y
+    void BuildPacket(uint64_t cycle, std::string& packet) const {
+        char text[1024];
+        double t = cycle * periodMs / 1000.0;
+        double x = 445.0 + 10.0 * t;
+        double y = 2.0 * sin(2.0 * 3.14159265358979 * 2.0 * t);
+        double a1 = atan2(y, x) * 180.0 / 3.14159265358979;
+
+        snprintf(text, sizeof(text),
+                 "<Rob Type=\"KUKA\">"
+                 "<RIst X=\"%.4f\" Y=\"%.4f\" Z=\"900.0000\" A=\"180.0000\" B=\"0.0000\" C=\"180.0000\"/>"
+                 "<RSol X=\"%.4f\" Y=\"%.4f\" Z=\"900.0000\" A=\"180.0000\" B=\"0.0000\" C=\"180.0000\"/>"
+                 "<AIPos A1=\"%.4f\" A2=\"-90.0000\" A3=\"90.0000\" A4=\"0.0000\" A5=\"0.0000\" A6=\"0.0000\"/>"
+                 "<ASPos A1=\"%.4f\" A2=\"-90.0000\" A3=\"90.0000\" A4=\"0.0000\" A5=\"0.0000\" A6=\"0.0000\"/>"
+                 "<Delay D=\"0\"/><Digin>%u</Digin><IPOC>%llu</IPOC></Rob>",
+                 x, y, x, y, a1, a1, (unsigned)(cycle / 250 % 2), (unsigned long long)ipoc);
+        packet.assign(text);
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  --send [options]           Send simulated RSI packets\n"
+              << "  Options:\n"
+              << "    --ip <address>           Receiver address (default 127.0.0.1)\n"
+              << "    --port <port>            Receiver UDP port (default " << RSI::DefaultPort << ")\n"
+              << "    --period <ms>            IPO cycle, 4 or 12 (default 4)\n"
+              << "    --count <packets>        Packets to send (default 2500, 10 s at 4 ms)\n"
+              << "    --check-replies          Expect an RSI reply to every packet (RSIReceiver --respond)\n"
+              << "    --drop <n>               Skip every nth packet\n"
+              << "    --duplicate <n>          Send every nth packet twice\n"
+              << "    --swap <n>               Send every nth packet after the one following it\n"
+              << "    --clock-ppm <ppm>        Run the IPOC clock this much faster than the host's\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || std::string(argv[1]) != "--send") {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string ip = "127.0.0.1";
+    int port = RSI::DefaultPort;
+    int period = 4;
+    uint64_t count = 2500;
+    bool checkReplies = false;
+    uint64_t dropEvery = 0;
+    uint64_t duplicateEvery = 0;
+    uint64_t swapEvery = 0;
+    double clockPpm = 0.0;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ip" && i + 1 < argc) ip = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) port = atoi(argv[++i]);
+        else if (arg == "--period" && i + 1 < argc) period = atoi(argv[++i]);
+        else if (arg == "--count" && i + 1 < argc) count = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--check-replies") checkReplies = true;
+        else if (arg == "--drop" && i + 1 < argc) dropEvery = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--duplicate" && i + 1 < argc) duplicateEvery = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--swap" && i + 1 < argc) swapEvery = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--clock-ppm" && i + 1 < argc) clockPpm = atof(argv[++i]);
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (period <= 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    RobotSim sim(period, checkReplies);
+    sim.SetFaults(dropEvery, duplicateEvery, swapEvery);
+    sim.SetClockPpm(clockPpm);
+    if (!sim.Open(ip, port)) {
+        std::cout << "ERROR:SOCKET_FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "Sending " << count << " packets to " << ip << ":" << port
+              << " every " << period << " ms" << std::endl;
+    sim.Run(count);
+    sim.PrintSummary();
+    return 0;
+}
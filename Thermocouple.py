@@ -4,6 +4,7 @@ import csv
 from datetime import datetime
 import time
 import os
+import subprocess
 import keyboard
 
 class ThermocoupleDAQ:
@@ -101,6 +102,38 @@ def write_to_csv(temperatures, timestamp, filename="thermocouple_data.csv"):
         print(f"Error writing to CSV: {e}")
         return False
 
+THERMOCOUPLE_RECORDER = os.path.join(os.path.dirname(__file__), "ThermocoupleRecorder.exe")
+
+def start_native_recording(filename, device_name="cDAQ1Mod1", sample_rate=3.5, channels=4, simulate=False):
+    """Record with the native ThermocoupleRecorder, which lets the module's
+    sample clock pace a continuous acquisition, reads every scan that is
+    ready on each poll and writes them to filename in the format of
+    write_to_csv, timed from the sample clock.  Without the module (or with
+    simulate) it records a simulated one.  Returns the process for
+    stop_native_recording."""
+    args = [THERMOCOUPLE_RECORDER, "--record", os.path.abspath(filename), "--rate", str(sample_rate),
+            "--channels", str(channels)]
+    if simulate:
+        args += ["--simulate"]
+    else:
+        args += ["--device", device_name]
+    try:
+        return subprocess.Popen(args, stdin=subprocess.PIPE, text=True)
+    except Exception as e:
+        print(f"Error starting thermocouple recorder: {e}")
+        return None
+
+def stop_native_recording(process, timeout=5):
+    """Ask ThermocoupleRecorder to finish writing and exit."""
+    if not process:
+        return
+    try:
+        process.communicate("q\n", timeout=timeout)
+    except subprocess.TimeoutExpired:
+        process.kill()
+    except Exception as e:
+        print(f"Error stopping thermocouple recorder: {e}")
+
 def print_temperature(temperatures, timestamp):
     """Print the temperature readings in a formatted way."""
     if temperatures is None:
@@ -0,0 +1,539 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RSICommon.h"
+
+#ifdef TC_NIDAQMX
+#include <NIDAQmx.h>
+#endif
+
+// Defaults of Thermocouple.py: an NI-9211 in a cDAQ chassis, four type K
+// thermocouples at 3.5 Hz per channel (the module's 14 Hz shared by four)
+const char* const DefaultDevice = "cDAQ1Mod1";
+const int DefaultChannels = 4;
+const double DefaultRate = 3.5;
+const double DefaultMinC = 0.0;              // nidaqmx's defaults for add_ai_thrmcpl_chan
+const double DefaultMaxC = 100.0;
+const int MaxChannels = 16;
+
+static std::atomic<bool> stopRequested(false);
+
+static void HandleStopSignal(int) {
+    stopRequested = true;
+}
+
+// Continuous, hardware-timed acquisition: Read returns every scan the
+// device has converted since the last call, channels interleaved per scan.
+class ThermocoupleSource {
+public:
+    virtual ~ThermocoupleSource() { }
+    virtual const char* Name() const = 0;
+    // The sample clock's rate after the driver coerced it
+    virtual double Rate() const = 0;
+    virtual bool Start() = 0;
+    virtual void Stop() = 0;
+    // false on a device error, which Stop and Start recover from
+    virtual bool Read(std::vector<double>& values, size_t& frames) = 0;
+};
+
+#ifdef TC_NIDAQMX
+// An NI-DAQmx thermocouple module, ai0 up to the channel count, with the
+// built-in cold-junction sensor.  The task buffers a minute of scans, so
+// the recorder can fall well behind before anything is lost.
+class DaqmxSource : public ThermocoupleSource {
+public:
+    DaqmxSource(const std::string& deviceName, int channelCount, int32 type, double minC, double maxC) :
+        device(deviceName),
+        channels(channelCount),
+        thermocoupleType(type),
+        minValue(minC),
+        maxValue(maxC) { }
+
+    ~DaqmxSource() override {
+        if (task) {
+            DAQmxClearTask(task);
+        }
+    }
+
+    // Whether the module exists, in a chassis or simulated in NI MAX
+    static bool Present(const std::string& deviceName, bool& simulated) {
+        char product[256];
+        bool32 isSimulated = 0;
+        if (DAQmxFailed(DAQmxGetDevProductType(deviceName.c_str(), product, sizeof(product)))) {
+            return false;
+        }
+        DAQmxGetDevIsSimulated(deviceName.c_str(), &isSimulated);
+        simulated = isSimulated != 0;
+        return true;
+    }
+
+    bool Open(double requestedRate) {
+        char physical[256];
+        snprintf(physical, sizeof(physical), "%s/ai0:%d", device.c_str(), channels - 1);
+        if (!Check(DAQmxCreateTask("", &task)) ||
+            !Check(DAQmxCreateAIThrmcplChan(task, physical, "", minValue, maxValue, DAQmx_Val_DegC,
+                                            thermocoupleType, DAQmx_Val_BuiltIn, 25.0, "")) ||
+            !Check(DAQmxCfgSampClkTiming(task, "", requestedRate, DAQmx_Val_Rising, DAQmx_Val_ContSamps,
+                                         BufferScans(requestedRate))) ||
+            !Check(DAQmxGetSampClkRate(task, &rate))) {
+            return false;
+        }
+        values.resize(BufferScans(rate) * channels);
+        return true;
+    }
+
+    const char* Name() const override { return "nidaqmx"; }
+    double Rate() const override { return rate; }
+
+    bool Start() override { return Check(DAQmxStartTask(task)); }
+
+    void Stop() override { DAQmxStopTask(task); }
+
+    bool Read(std::vector<double>& out, size_t& frames) override {
+        uInt32 available = 0;
+        frames = 0;
+        if (!Check(DAQmxGetReadAvailSampPerChan(task, &available))) {
+            return false;
+        }
+        if (available == 0) {
+            return true;
+        }
+        if (available > values.size() / channels) {
+            available = (uInt32)(values.size() / channels);
+        }
+        int32 read = 0;
+        if (!Check(DAQmxReadAnalogF64(task, (int32)available, 1.0, DAQmx_Val_GroupByScanNumber,
+                                      values.data(), (uInt32)values.size(), &read, nullptr))) {
+            return false;
+        }
+        frames = (size_t)read;
+        out.assign(values.begin(), values.begin() + frames * channels);
+        return true;
+    }
+
+private:
+    std::string device;
+    int channels;
+    int32 thermocoupleType;
+    double minValue;
+    double maxValue;
+    TaskHandle task = 0;
+    float64 rate = 0.0;
+    std::vector<double> values;
+
+    static uInt64 BufferScans(double scanRate) {
+        uInt64 scans = (uInt64)(scanRate * 60.0);
+        return scans < 1000 ? 1000 : scans;
+    }
+
+    static bool Check(int32 error) {
+        if (DAQmxFailed(error)) {
+            char message[2048];
+            DAQmxGetExtendedErrorInfo(message, sizeof(message));
+            std::cout << "DAQmx: " << message << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Thermocouple type letter to the DAQmx constant, 0 if unknown
+static int32 DaqmxThermocoupleType(char letter) {
+    switch (toupper((unsigned char)letter)) {
+    case 'B': return DAQmx_Val_B_Type_TC;
+    case 'E': return DAQmx_Val_E_Type_TC;
+    case 'J': return DAQmx_Val_J_Type_TC;
+    case 'K': return DAQmx_Val_K_Type_TC;
+    case 'N': return DAQmx_Val_N_Type_TC;
+    case 'R': return DAQmx_Val_R_Type_TC;
+    case 'S': return DAQmx_Val_S_Type_TC;
+    case 'T': return DAQmx_Val_T_Type_TC;
+    default: return 0;
+    }
+}
+#endif
+
+// Stand-in for the module when there is no chassis: a weld pass heating
+// the plate every 30 s, reaching the channels one after another and
+// cooling off, with a little noise.  Each scan becomes readable once the
+// next tick of its sample clock has passed, as a converting module's
+// would, and the clock can run clockPpm off the host's to test the fit.
+class SimulatedSource : public ThermocoupleSource {
+public:
+    SimulatedSource(int channelCount, double scanRate, double ppm) :
+        channels(channelCount),
+        rate(scanRate),
+        clockRate(scanRate * (1.0 + ppm * 1e-6)),
+        random(1),
+        noise(0.0, 0.05) { }
+
+    const char* Name() const override { return "simulated"; }
+    double Rate() const override { return rate; }
+
+    bool Start() override {
+        start = std::chrono::steady_clock::now();
+        produced = 0;
+        return true;
+    }
+
+    void Stop() override { }
+
+    bool Read(std::vector<double>& values, size_t& frames) override {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t ready = (uint64_t)(elapsed * clockRate);
+        ready = ready > 0 ? ready - 1 : 0;
+        frames = (size_t)(ready - produced);
+        values.resize(frames * channels);
+        for (size_t i = 0; i < frames; i++) {
+            double t = (produced + i) / rate;
+            double phase = fmod(t, 30.0);
+            for (int c = 0; c < channels; c++) {
+                // Arrives 2 s later and 40 % cooler at each further channel
+                double since = phase - 5.0 - 2.0 * c;
+                double heat = since > 0 ? 400.0 * pow(0.6, c) * since / 3.0 * exp(1.0 - since / 3.0) : 0.0;
+                values[i * channels + c] = 22.0 + heat + noise(random);
+            }
+        }
+        produced += frames;
+        return true;
+    }
+
+private:
+    int channels;
+    double rate;
+    double clockRate;
+    std::chrono::steady_clock::time_point start;
+    uint64_t produced = 0;
+    std::mt19937 random;
+    std::normal_distribution<double> noise;
+};
+
+// Records the thermocouples to the CSV format of Thermocouple.py's
+// write_to_csv while the device's sample clock paces the acquisition.
+// Every poll reads all the scans converted since the last one, and each
+// scan is timestamped from its index on the sample clock rather than from
+// when the read returned.  The sample clock is fitted to host time the way
+// the RSI receiver fits the IPOC (ClockFit): the last scan of each read
+// had been converted by the time the read returned, a scan period after
+// its clock edge, so that return time less one period is a late-only
+// observation of its edge, and the floor line through them gives every
+// scan a host time free of polling jitter with the module's drift as its
+// slope.  A read error stops and restarts the task; the scans missed in
+// between are skipped on the clock so later times stay right.
+class ThermocoupleRecorder {
+public:
+    ThermocoupleRecorder(std::unique_ptr<ThermocoupleSource> sampleSource, int channelCount, int pollMs) :
+        source(std::move(sampleSource)),
+        channels(channelCount),
+        pollInterval(pollMs),
+        clock(ClockBlock(source->Rate(), pollMs), ClockWindowBlocks, 1e9 / source->Rate()) { }
+
+    ~ThermocoupleRecorder() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool OpenOutput(const std::string& path) {
+        file = fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        fputs("Timestamp,Relative Time (s)", file);
+        for (int c = 0; c < channels; c++) {
+            fprintf(file, ",Channel %d (\xC2\xB0" "C)", c);
+        }
+        fputs("\n", file);
+        return true;
+    }
+
+    // Run until stopRequested or the time limit
+    void Record(double seconds) {
+        std::vector<double> values;
+        if (!source->Start()) {
+            std::cout << "ERROR:START_FAILED" << std::endl;
+            return;
+        }
+        int64_t startNs = RSI::HostClock::NowNs();
+        int64_t lastReadNs = startNs;
+        int64_t nextReport = startNs + 2000000000LL;
+        double period = 1e9 / source->Rate();
+        bool reportedFirst = false;
+
+        while (!stopRequested && (seconds <= 0 || RSI::HostClock::NowNs() - startNs < seconds * 1e9)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollInterval));
+            size_t frames = 0;
+            int64_t before = RSI::HostClock::NowNs();
+            bool ok = source->Read(values, frames);
+            int64_t now = RSI::HostClock::NowNs();
+            readTime.Add(now - before);
+            reads++;
+            if (!ok) {
+                readErrors++;
+                source->Stop();
+                if (!source->Start()) {
+                    std::cout << "ERROR:RESTART_FAILED" << std::endl;
+                    break;
+                }
+                // Skip the scans the restart missed on the clock, counting
+                // each span once when errors follow one another
+                skipped += (uint64_t)((now - lastReadNs) / period);
+                lastReadNs = now;
+                restarts++;
+                continue;
+            }
+            lastReadNs = now;
+            if (frames == 0) {
+                emptyReads++;
+                continue;
+            }
+            if (!reportedFirst) {
+                std::cout << "First scan received! Recording started." << std::endl;
+                reportedFirst = true;
+            }
+            if (frames > maxFrames) {
+                maxFrames = frames;
+            }
+
+            uint64_t lastTick = skipped + scans + frames - 1;
+            int64_t lastNs = clock.Add((int64_t)lastTick, before - (int64_t)period);
+            double tickNs = clock.TickNs();
+            for (size_t i = 0; i < frames; i++) {
+                int64_t scanNs = lastNs - (int64_t)((frames - 1 - i) * tickNs);
+                WriteScan(scanNs, &values[i * channels]);
+            }
+            scans += frames;
+            fflush(file);
+
+            if (now >= nextReport) {
+                const double* latest = &values[(frames - 1) * channels];
+                std::cout << "Recorded " << scans << " scans (" << scans / source->Rate() << " s, drift "
+                          << clock.DriftPpm() << " ppm):";
+                for (int c = 0; c < channels; c++) {
+                    printf(" %.2f", latest[c]);
+                }
+                std::cout << " C" << std::endl;
+                nextReport += 2000000000LL;
+            }
+        }
+        source->Stop();
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void PrintSummary() const {
+        printf("OK:RECORD_COMPLETE\n");
+        printf("SOURCE:%s\n", source->Name());
+        printf("RATE:%.6f\n", source->Rate());
+        printf("CHANNELS:%d\n", channels);
+        printf("SCANS:%llu\n", (unsigned long long)scans);
+        printf("SECONDS:%.3f\n", scans / source->Rate());
+        printf("READS:calls=%llu,empty=%llu,max_scans=%llu\n", (unsigned long long)reads,
+               (unsigned long long)emptyReads, (unsigned long long)maxFrames);
+        printf("SKIPPED:%llu\n", (unsigned long long)skipped);
+        printf("CLOCK:drift_ppm=%.3f,fits=%llu,outliers=%llu,resets=%llu\n", clock.DriftPpm(),
+               (unsigned long long)clock.fits, (unsigned long long)clock.outliers,
+               (unsigned long long)clock.resets);
+        if (clock.residual.Count() > 0) {
+            printf("CLOCK_RESIDUAL_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   clock.residual.PercentileUs(0.50), clock.residual.PercentileUs(0.99),
+                   clock.residual.MaxUs(), clock.residual.MeanUs());
+        }
+        if (readTime.Count() > 0) {
+            printf("READ_US:p50=%.0f,p99=%.0f,max=%.0f,mean=%.1f\n",
+                   readTime.PercentileUs(0.50), readTime.PercentileUs(0.99),
+                   readTime.MaxUs(), readTime.MeanUs());
+        }
+        printf("ERRORS:read=%llu,restarts=%llu,write=%llu\n", (unsigned long long)readErrors,
+               (unsigned long long)restarts, (unsigned long long)writeErrors);
+        fflush(stdout);
+    }
+
+private:
+    // A few minutes of floor points per fit
+    static const size_t ClockWindowBlocks = 120;
+
+    std::unique_ptr<ThermocoupleSource> source;
+    int channels;
+    int pollInterval;                          // Milliseconds between reads
+    FILE* file = nullptr;
+    RSI::ClockFit clock;
+    RSI::LatencyHistogram readTime;            // Time spent in the driver's read
+    int64_t firstNs = 0;
+    bool haveFirst = false;
+    uint64_t scans = 0;
+    uint64_t skipped = 0;                      // Scans lost to restarts
+    uint64_t reads = 0;
+    uint64_t emptyReads = 0;
+    uint64_t maxFrames = 0;
+    uint64_t readErrors = 0;
+    uint64_t restarts = 0;
+    uint64_t writeErrors = 0;
+
+    // Reads that return scans, about two seconds of them
+    static int ClockBlock(double rate, int pollMs) {
+        double readsPerSecond = 1000.0 / pollMs < rate ? 1000.0 / pollMs : rate;
+        int block = (int)(readsPerSecond * 2.0);
+        return block < 4 ? 4 : block;
+    }
+
+    // One row as write_to_csv writes it, with the scan's sample clock time
+    void WriteScan(int64_t scanNs, const double* values) {
+        if (!haveFirst) {
+            firstNs = scanNs;
+            haveFirst = true;
+        }
+        char timestamp[64];
+        RSI::HostClock::FormatLocal(scanNs, timestamp, sizeof(timestamp));
+        int result = fprintf(file, "%s,%.6f", timestamp, (scanNs - firstNs) / 1e9);
+        for (int c = 0; c < channels && result >= 0; c++) {
+            result = fprintf(file, ",%.2f", values[c]);
+        }
+        if (result < 0 || fputs("\n", file) < 0) {
+            writeErrors++;
+        }
+    }
+};
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  --record <file.csv> [options]  Record until Ctrl+C or 'q'\n"
+              << "  Options:\n"
+#ifdef TC_NIDAQMX
+              << "    --device <name>          Thermocouple module (default " << DefaultDevice << ")\n"
+              << "    --type <letter>          Thermocouple type, B E J K N R S T (default K)\n"
+              << "    --min <C> / --max <C>    Expected temperature range (default " << DefaultMinC << " to "
+              << DefaultMaxC << ")\n"
+              << "    --require-device         Fail instead of simulating when the module is missing\n"
+#endif
+              << "    --simulate               Simulated module instead of a device\n"
+              << "    --clock-ppm <ppm>        Run the simulated module's sample clock fast (default 0)\n"
+              << "    --channels <n>           Channels ai0 upwards (default " << DefaultChannels << ")\n"
+              << "    --rate <hz>              Scans per second, coerced by the driver (default " << DefaultRate << ")\n"
+              << "    --poll <ms>              Time between reads (default 50)\n"
+              << "    --seconds <s>            Stop after this long (default until stopped)\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || std::string(argv[1]) != "--record") {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string outputPath = argv[2];
+    std::string device = DefaultDevice;
+    std::string type = "K";
+    double minC = DefaultMinC;
+    double maxC = DefaultMaxC;
+    bool requireDevice = false;
+    bool simulate = false;
+    double clockPpm = 0.0;
+    int channels = DefaultChannels;
+    double rate = DefaultRate;
+    int pollMs = 50;
+    double seconds = 0.0;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--device" && i + 1 < argc) device = argv[++i];
+        else if (arg == "--type" && i + 1 < argc) type = argv[++i];
+        else if (arg == "--min" && i + 1 < argc) minC = atof(argv[++i]);
+        else if (arg == "--max" && i + 1 < argc) maxC = atof(argv[++i]);
+        else if (arg == "--require-device") requireDevice = true;
+        else if (arg == "--simulate") simulate = true;
+        else if (arg == "--clock-ppm" && i + 1 < argc) clockPpm = atof(argv[++i]);
+        else if (arg == "--channels" && i + 1 < argc) channels = atoi(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc) rate = atof(argv[++i]);
+        else if (arg == "--poll" && i + 1 < argc) pollMs = atoi(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) seconds = atof(argv[++i]);
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (rate <= 0 || pollMs <= 0 || minC >= maxC || type.size() != 1) {
+        PrintUsage();
+        return 1;
+    }
+    if (channels < 1 || channels > MaxChannels) {
+        std::cout << "ERROR:BAD_CHANNELS 1 to " << MaxChannels << " channels" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<ThermocoupleSource> source;
+#ifdef TC_NIDAQMX
+    bool simulatedInMax = false;
+    if (!simulate && DaqmxSource::Present(device, simulatedInMax)) {
+        int32 daqmxType = DaqmxThermocoupleType(type[0]);
+        if (daqmxType == 0) {
+            std::cout << "ERROR:BAD_TYPE " << type << std::endl;
+            return 1;
+        }
+        std::unique_ptr<DaqmxSource> daqmx(new DaqmxSource(device, channels, daqmxType, minC, maxC));
+        if (!daqmx->Open(rate)) {
+            std::cout << "ERROR:TASK_SETUP_FAILED " << device << std::endl;
+            return 1;
+        }
+        std::cout << "Recording " << device << (simulatedInMax ? " (simulated in NI MAX)" : "") << ", "
+                  << channels << " channel(s) at " << daqmx->Rate() << " Hz" << std::endl;
+        source = std::move(daqmx);
+    } else if (!simulate) {
+        if (requireDevice) {
+            std::cout << "ERROR:DEVICE_NOT_FOUND " << device << std::endl;
+            return 1;
+        }
+        std::cout << "Thermocouple module " << device << " not found, using the simulated module" << std::endl;
+    }
+#else
+    (void)device;
+    (void)requireDevice;
+    if (!simulate) {
+        std::cout << "Built without NI-DAQmx, using the simulated module" << std::endl;
+    }
+#endif
+    if (!source) {
+        source.reset(new SimulatedSource(channels, rate, clockPpm));
+        std::cout << "Recording the simulated module, " << channels << " channel(s) at " << rate << " Hz" << std::endl;
+    }
+
+    ThermocoupleRecorder recorder(std::move(source), channels, pollMs);
+    if (!recorder.OpenOutput(outputPath)) {
+        std::cout << "ERROR:FILE_OPEN_FAILED " << outputPath << std::endl;
+        return 1;
+    }
+
+    // Ctrl+C, or 'q' from Thermocouple.py; end of input only ends an untimed run
+    std::signal(SIGINT, HandleStopSignal);
+    std::signal(SIGTERM, HandleStopSignal);
+    std::thread([seconds]() {
+        std::string input;
+        while (std::getline(std::cin, input)) {
+            if (input == "q" || input == "Q") {
+                stopRequested = true;
+                return;
+            }
+        }
+        // Input closed: the parent script is gone, unless stdin was never
+        // connected (a scheduler or service), which --seconds covers
+        if (seconds <= 0) {
+            stopRequested = true;
+        }
+    }).detach();
+
+    std::cout << "OK:RECORDING_STARTED" << std::endl;
+    recorder.Record(seconds);
+    recorder.PrintSummary();
+    return 0;
+}